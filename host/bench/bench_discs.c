@@ -0,0 +1,359 @@
+/*
+ * Starts popcorn on multi disc EBOOTs, cold and with a warm probe cache, and
+ * checks which discs of their PSTITLEIMG table it keeps and which config
+ * overlays each one: a table ending at an entry that doesn't grow or wraps,
+ * a disc without the PSISOIMG magic, more entries than pops plays,
+ * CONFIGn.BIN picked per disc over CONFIG.BIN, configs that don't fit the
+ * emulator's config region and one that can't be read. Prints the sceIo
+ * calls each startup costs.
+ */
+
+#define _GNU_SOURCE
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pspkernel.h>
+#include <cfwmacros.h>
+
+#include "overlay.h"
+#include "sim.h"
+
+#define PSAR_OFFSET 0x1000
+#define EBOOT_SIZE 0x40000
+#define TABLE_ENTRIES 8
+#define CONFIG_OFFSET 0x420
+#define CONFIG_SIZE 0x40
+#define LIBCRYPT_WORD_OFFSET 0x12B0
+#define CONFIG_MAX_SIZE (LIBCRYPT_WORD_OFFSET - CONFIG_OFFSET)
+#define LIBCRYPT_WORD (40416 ^ 0x72D0EE59) // _SLES_02080
+
+#define NONE -1
+#define NO_CONFIG -2
+#define SHARED 0 // CONFIG.BIN, n for CONFIGn.BIN
+
+struct Fixture
+{
+    const char *title;
+    u32 table[TABLE_ENTRIES]; // PSTITLEIMG+0x200, relative to the PSAR
+    u32 bad; // entries whose PSISOIMG magic is broken
+    u32 configs; // bit 0 for CONFIG.BIN, bit n for CONFIGn.BIN
+    u32 full; // configs that fill the whole config region
+    u32 oversize; // configs one byte too big for it
+    int unreadable; // config whose reads fail, NONE for none
+    int expected[TABLE_ENTRIES]; // config each entry gets, NO_CONFIG for none, NONE for a disc that isn't used
+};
+
+static const struct Fixture g_fixtures[] = {
+    // the fourth entry goes back, the table ends there; disc 2 is broken
+    { "SLUS00001", { 0x8000, 0x10000, 0x18000, 0x9000, 0x20000 }, 1 << 1, 1 | (1 << 3), 0, 0, NONE,
+        { SHARED, NONE, 3, NONE, NONE } },
+    // pops plays 5 discs, a sixth entry is never looked at
+    { "SLUS00002", { 0x8000, 0x10000, 0x18000, 0x20000, 0x28000, 0x30000 }, 0, 1 | (1 << 5) | (1 << 6), 0, 0, NONE,
+        { SHARED, SHARED, SHARED, SHARED, 5, NONE } },
+    // the second entry wraps around behind the PSAR; one disc left, which only has CONFIG.BIN
+    { "SLUS00003", { 0x8000, 0xFFFFF000, 0x10000 }, 0, 1 | (1 << 1), 0, 0, NONE,
+        { SHARED, NONE, NONE } },
+    // a CONFIG2.BIN that doesn't fit falls back to CONFIG.BIN, which fills the region
+    { "SLUS00004", { 0x8000, 0x10000, 0x18000 }, 0, 1 | (1 << 2) | (1 << 3), 1, 1 << 2, NONE,
+        { SHARED, SHARED, 3 } },
+    // nothing fits, the discs are still played, without a config
+    { "SLUS00005", { 0x8000, 0x10000 }, 0, 1 | (1 << 1), 0, 1 | (1 << 1), NONE,
+        { NO_CONFIG, NO_CONFIG } },
+    // every disc has its own config, CONFIG2.BIN can't be read and CONFIG.BIN stands in
+    { "SLUS00006", { 0x8000, 0x10000 }, 0, 1 | (1 << 1) | (1 << 2), 0, 0, 2,
+        { 1, SHARED } },
+};
+
+extern int g_isCustomPBP;
+extern int g_icon0Status;
+
+extern void loadPluginConfig(void);
+extern int loadProbeCache(void);
+extern void saveProbeCache(void);
+extern int probeEboot(void);
+extern void readDiscOffsets(void);
+extern void readCustomConfig(void);
+extern void buildPatchPlan(void);
+extern unsigned int isCustomPBP(void);
+extern int getIcon0Status(void);
+
+static int g_failures;
+
+static void check(int cond, const char *title, const char *what, int entry)
+{
+    if(!cond)
+    {
+        fprintf(stderr, "%s: %s, table entry %d\n", title, what, entry + 1);
+        g_failures++;
+    }
+}
+
+static int writeFile(const char *path, const void *data, size_t size)
+{
+    char host[512];
+    FILE *f = fopen(simHostPath(path, host, sizeof(host)), "wb");
+
+    if(f == NULL)
+    {
+        perror(host);
+        return -1;
+    }
+
+    fwrite(data, 1, size, f);
+    fclose(f);
+
+    return 0;
+}
+
+static void gamePath(const struct Fixture *fixture, const char *name, char *path, size_t size)
+{
+    snprintf(path, size, "ms0:/PSP/GAME/%s/%s", fixture->title, name);
+}
+
+static void configName(int n, char *name)
+{
+    if(n == SHARED)
+    {
+        strcpy(name, "CONFIG.BIN");
+    }
+    else
+    {
+        strcpy(name, "CONFIG0.BIN");
+        name[6] = '0' + n;
+    }
+}
+
+static unsigned char configByte(int n)
+{
+    return (unsigned char)(0xC0 + n);
+}
+
+static u32 configSize(const struct Fixture *fixture, int n)
+{
+    if(fixture->oversize & (1 << n))
+    {
+        return CONFIG_MAX_SIZE + 1;
+    }
+
+    return (fixture->full & (1 << n)) ? CONFIG_MAX_SIZE : CONFIG_SIZE;
+}
+
+static int buildFixture(const struct Fixture *fixture)
+{
+    unsigned char *eboot = calloc(1, EBOOT_SIZE);
+    unsigned char config[CONFIG_MAX_SIZE + 1];
+    u32 *header = (u32 *)eboot;
+    char path[256], host[512];
+    int i, ret;
+
+    if(eboot == NULL)
+    {
+        return -1;
+    }
+
+    header[0] = 0x50425000;
+    header[1] = 0x00010000;
+
+    for(i=2; i<8; i++)
+    {
+        header[i] = 0x28;
+    }
+
+    header[8] = 0x100;
+    header[9] = PSAR_OFFSET;
+
+    memcpy(eboot + PSAR_OFFSET, "PSTITLEIMG0000", 14);
+    memcpy(eboot + PSAR_OFFSET + 0x200, fixture->table, sizeof(fixture->table));
+
+    for(i=0; i<TABLE_ENTRIES; i++)
+    {
+        u32 offset = PSAR_OFFSET + fixture->table[i];
+
+        if(fixture->table[i] == 0 || offset < PSAR_OFFSET || offset + LIBCRYPT_WORD_OFFSET + 4 > EBOOT_SIZE)
+        {
+            continue;
+        }
+
+        memcpy(eboot + offset, (fixture->bad & (1 << i)) ? "PSXISOIMG000" : "PSISOIMG0000", 12);
+        memcpy(eboot + offset + 0x400, "_SLES_02080", 11);
+    }
+
+    gamePath(fixture, "", path, sizeof(path));
+    mkdir(simHostPath(path, host, sizeof(host)), 0777);
+    gamePath(fixture, "EBOOT.PBP", path, sizeof(path));
+    ret = writeFile(path, eboot, EBOOT_SIZE);
+    free(eboot);
+
+    for(i=0; i<TABLE_ENTRIES && ret == 0; i++)
+    {
+        char name[16];
+
+        if(!(fixture->configs & (1 << i)))
+        {
+            continue;
+        }
+
+        configName(i, name);
+        memset(config, configByte(i), sizeof(config));
+        gamePath(fixture, name, path, sizeof(path));
+        ret = writeFile(path, config, configSize(fixture, i));
+    }
+
+    return ret;
+}
+
+// what module_start does before pops runs
+static void startup(void)
+{
+    loadPluginConfig();
+
+    if(loadProbeCache() < 0)
+    {
+        probeEboot();
+        readDiscOffsets();
+        g_isCustomPBP = isCustomPBP();
+        g_icon0Status = getIcon0Status();
+        saveProbeCache();
+    }
+
+    readCustomConfig();
+    buildPatchPlan();
+}
+
+// reads the config region and libcrypt word of every table entry through the overlays
+static void verify(const struct Fixture *fixture, const char *pass)
+{
+    unsigned char buf[CONFIG_MAX_SIZE], expect[CONFIG_MAX_SIZE];
+    char what[64];
+    u32 word;
+    int i;
+
+    for(i=0; i<TABLE_ENTRIES; i++)
+    {
+        u32 offset = PSAR_OFFSET + fixture->table[i];
+        int n = fixture->expected[i];
+
+        if(fixture->table[i] == 0 || offset < PSAR_OFFSET)
+        {
+            continue;
+        }
+
+        memset(buf, 0, sizeof(buf));
+        overlayApply(OVERLAY_EBOOT, buf, offset + CONFIG_OFFSET, sizeof(buf), sizeof(buf));
+        memset(expect, 0, sizeof(expect));
+
+        if(n >= 0)
+        {
+            memset(expect, configByte(n), configSize(fixture, n));
+        }
+
+        snprintf(what, sizeof(what), "%s config", pass);
+        check(memcmp(buf, expect, sizeof(buf)) == 0, fixture->title, what, i);
+
+        word = 0;
+        overlayApply(OVERLAY_EBOOT, (u8 *)&word, offset + LIBCRYPT_WORD_OFFSET, sizeof(word), sizeof(word));
+        snprintf(what, sizeof(what), "%s libcrypt word", pass);
+        check(word == (n == NONE ? 0 : LIBCRYPT_WORD), fixture->title, what, i);
+    }
+}
+
+static int benchMain(void *arg)
+{
+    size_t i;
+
+    UNUSED(arg);
+
+    for(i=0; i<NELEMS(g_fixtures); i++)
+    {
+        const struct Fixture *fixture = &g_fixtures[i];
+        char path[256];
+        unsigned int io[2];
+        int pass;
+
+        gamePath(fixture, "EBOOT.PBP", path, sizeof(path));
+        simSetInitFileName(path);
+        simSetReadError(NULL);
+
+        if(fixture->unreadable != NONE)
+        {
+            char name[16];
+
+            configName(fixture->unreadable, name);
+            gamePath(fixture, name, path, sizeof(path));
+            simSetReadError(path);
+        }
+
+        for(pass=0; pass<2; pass++)
+        {
+            unsigned int before = simIoTotal(&g_simIoStats);
+
+            startup();
+            io[pass] = simIoTotal(&g_simIoStats) - before;
+            verify(fixture, pass == 0 ? "cold" : "warm");
+        }
+
+        printf("%s: %u sceIo calls cold, %u warm\n", fixture->title, io[0], io[1]);
+    }
+
+    return 0;
+}
+
+static int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    UNUSED(st);
+    UNUSED(flag);
+    UNUSED(ftw);
+
+    return remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dirs[] = { "ms0", "ms0/PSP", "ms0/PSP/GAME", "ms0/seplugins" };
+    char root[] = "/tmp/popcorn-discs-XXXXXX";
+    char path[512];
+    size_t i;
+    int ret = 0;
+
+    UNUSED(argc);
+    UNUSED(argv);
+
+    if(mkdtemp(root) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    simSetRoot(root);
+
+    for(i=0; i<NELEMS(dirs); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        mkdir(path, 0777);
+    }
+
+    for(i=0; i<NELEMS(g_fixtures) && ret == 0; i++)
+    {
+        ret = buildFixture(&g_fixtures[i]);
+    }
+
+    if(ret == 0)
+    {
+        ret = simRunLowStack(benchMain, NULL);
+    }
+
+    if(ret == 0 && g_failures)
+    {
+        fprintf(stderr, "%d check(s) failed\n", g_failures);
+        ret = 1;
+    }
+
+    nftw(root, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+    return ret;
+}
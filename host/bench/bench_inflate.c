@@ -0,0 +1,509 @@
+/*
+ * Checks the module's inflate against sceKernelDeflateDecompress (zlib in the
+ * simulator) block by block and compares their throughput.
+ *
+ *   popcorn_bench_inflate [-r rounds] [-n blocks] [-f fuzz] [EBOOT.PBP ...]
+ *
+ * EBOOTs must hold a single disc PSISOIMG0000 with a plain index table, as
+ * written by popstation and similar tools; their deflated blocks are used as
+ * they are. Without arguments a synthetic set is deflated with several zlib
+ * strategies so stored, fixed and dynamic blocks all show up.
+ *
+ * Each block is also repacked as LZ4 the way popcorn_repack does it and
+ * decoded with src/lz4.c, to compare against the cost of inflating it.
+ *
+ * Every block has to inflate to the same bytes on both sides. -f also feeds
+ * that many corrupted blocks to both decoders, which have to agree on whether
+ * the block is valid and on its contents.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <pspkernel.h>
+#include <cfwmacros.h>
+
+#include "inflate.h"
+#include "lz4.h"
+#include "lz4pack.h"
+
+#define ISO_BLOCK_SIZE 0x9300
+#define PSISO_INDEX_OFFSET 0x4000
+#define PSISO_DATA_OFFSET 0x100000
+#define SYNTH_BLOCKS 64
+// inflate may read a little past the end of a stream, zlib even more on bad ones
+#define BLOCK_PADDING 0x10000
+
+struct Block
+{
+    unsigned char *data;
+    u32 size;
+    unsigned char *lz4; // NULL when LZ4 does not fit in a block
+    u32 lz4size;
+};
+
+struct BlockSet
+{
+    struct Block *blocks;
+    int count;
+    int max;
+};
+
+static InflateState g_state;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int addBlock(struct BlockSet *set, const unsigned char *data, u32 size)
+{
+    struct Block *block;
+
+    if(set->count == set->max)
+    {
+        set->max = set->max ? set->max * 2 : 64;
+        set->blocks = realloc(set->blocks, set->max * sizeof(*set->blocks));
+    }
+
+    block = &set->blocks[set->count];
+    block->data = calloc(1, size + BLOCK_PADDING);
+
+    if(block->data == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(block->data, data, size);
+    block->size = size;
+    block->lz4 = NULL;
+    set->count++;
+
+    return 0;
+}
+
+static void freeBlocks(struct BlockSet *set)
+{
+    int i;
+
+    for(i=0; i<set->count; i++)
+    {
+        free(set->blocks[i].data);
+        free(set->blocks[i].lz4);
+    }
+
+    free(set->blocks);
+    memset(set, 0, sizeof(*set));
+}
+
+static size_t deflateRaw(const unsigned char *src, unsigned char *dest, size_t size, int level, int strategy)
+{
+    z_stream zs;
+
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, level, Z_DEFLATED, -15, 8, strategy);
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = ISO_BLOCK_SIZE;
+    zs.next_out = dest;
+    zs.avail_out = size;
+    deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+
+    return zs.total_out;
+}
+
+static void synthBlock(unsigned char *plain, int kind)
+{
+    static const char *words[] = { "SLES", "_020", "80;1", "XA", "STR", "MOV", "\0\0\0\0", "\xFF\xFF" };
+    int i = 0, j;
+
+    switch(kind)
+    {
+        case 0: // sector data, short runs of a few values
+            for(i=0; i<ISO_BLOCK_SIZE; i++)
+            {
+                plain[i] = (i & 7) == 0 || (rand() & 3) == 0 ? (unsigned char)(rand() & 0x1F) : plain[i-1];
+            }
+            break;
+        case 1: // text like, lots of matches
+            while(i < ISO_BLOCK_SIZE)
+            {
+                const char *w = words[rand() % NELEMS(words)];
+                int len = strlen(w) ? strlen(w) : 4;
+
+                for(j=0; j<len && i<ISO_BLOCK_SIZE; j++)
+                {
+                    plain[i++] = w[j];
+                }
+            }
+            break;
+        case 2: // noise, stays stored
+            for(i=0; i<ISO_BLOCK_SIZE; i++)
+            {
+                plain[i] = (unsigned char)rand();
+            }
+            break;
+        default: // mostly empty sectors
+            memset(plain, 0, ISO_BLOCK_SIZE);
+
+            for(i=0; i<64; i++)
+            {
+                plain[rand() % ISO_BLOCK_SIZE] = (unsigned char)rand();
+            }
+            break;
+    }
+}
+
+static int synthBlocks(struct BlockSet *set)
+{
+    static const int strategies[][2] = {
+        { 9, Z_DEFAULT_STRATEGY }, { 1, Z_DEFAULT_STRATEGY }, { 9, Z_FIXED },
+        { 9, Z_HUFFMAN_ONLY }, { 9, Z_RLE }, { 0, Z_DEFAULT_STRATEGY },
+    };
+    unsigned char *plain = malloc(ISO_BLOCK_SIZE);
+    unsigned char *packed = malloc(ISO_BLOCK_SIZE * 2);
+    int i;
+
+    srand(2080);
+
+    for(i=0; i<SYNTH_BLOCKS; i++)
+    {
+        const int *s = strategies[i % NELEMS(strategies)];
+        size_t size;
+
+        synthBlock(plain, (i / NELEMS(strategies)) % 4);
+        size = deflateRaw(plain, packed, ISO_BLOCK_SIZE * 2, s[0], s[1]);
+
+        if(addBlock(set, packed, size) < 0)
+        {
+            return -1;
+        }
+    }
+
+    free(plain);
+    free(packed);
+
+    return 0;
+}
+
+// deflated blocks of a popstation style EBOOT, stored blocks are skipped
+static int loadEboot(struct BlockSet *set, const char *path, int max)
+{
+    FILE *f = fopen(path, "rb");
+    unsigned char *buf = malloc(ISO_BLOCK_SIZE);
+    u32 header[10], psar, entry[8], i;
+    char magic[12];
+    int ret = -1;
+
+    if(f == NULL)
+    {
+        perror(path);
+        free(buf);
+        return -1;
+    }
+
+    if(fread(header, 1, sizeof(header), f) != sizeof(header) || header[0] != 0x50425000)
+    {
+        fprintf(stderr, "%s: not a PBP\n", path);
+        goto out;
+    }
+
+    psar = header[9];
+    fseek(f, psar, SEEK_SET);
+
+    if(fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, "PSISOIMG0000", 12) != 0)
+    {
+        fprintf(stderr, "%s: no single disc PSISOIMG0000 at 0x%X\n", path, psar);
+        goto out;
+    }
+
+    for(i=0; i<(PSISO_DATA_OFFSET - PSISO_INDEX_OFFSET) / sizeof(entry) && set->count < max; i++)
+    {
+        u32 offset, size;
+
+        fseek(f, psar + PSISO_INDEX_OFFSET + i * sizeof(entry), SEEK_SET);
+
+        if(fread(entry, 1, sizeof(entry), f) != sizeof(entry))
+        {
+            break;
+        }
+
+        offset = entry[0];
+        size = entry[1] & 0xFFFF;
+
+        if(size == 0)
+        {
+            break;
+        }
+
+        if(size >= ISO_BLOCK_SIZE)
+        {
+            continue;
+        }
+
+        fseek(f, psar + PSISO_DATA_OFFSET + offset, SEEK_SET);
+
+        if(fread(buf, 1, size, f) != size || addBlock(set, buf, size) < 0)
+        {
+            fprintf(stderr, "%s: cannot read block %u\n", path, i);
+            goto out;
+        }
+    }
+
+    ret = 0;
+
+out:
+    fclose(f);
+    free(buf);
+
+    return ret;
+}
+
+static int verify(const char *name, const struct BlockSet *set, unsigned char *ref, unsigned char *out)
+{
+    int i;
+
+    for(i=0; i<set->count; i++)
+    {
+        int r = sceKernelDeflateDecompress(ref, ISO_BLOCK_SIZE, set->blocks[i].data, 0);
+        int o = inflateBlock(out, ISO_BLOCK_SIZE, set->blocks[i].data, &g_state);
+
+        if(r != o || (r > 0 && memcmp(ref, out, r) != 0))
+        {
+            fprintf(stderr, "%s: block %d (%u bytes) inflates to %d bytes, sceKernelDeflateDecompress %d\n",
+                name, i, set->blocks[i].size, o, r);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// repacks every block as LZ4 and checks that it decodes to the same bytes
+static int packLz4(const char *name, const struct BlockSet *set, unsigned char *ref, unsigned char *out)
+{
+    unsigned char *packed = malloc(ISO_BLOCK_SIZE);
+    int i;
+
+    for(i=0; i<set->count; i++)
+    {
+        struct Block *block = &set->blocks[i];
+        int len = sceKernelDeflateDecompress(ref, ISO_BLOCK_SIZE, block->data, 0);
+        size_t size = lz4PackBlock(ref, len, packed, ISO_BLOCK_SIZE - 1 - LZ4_BLOCK_HEADER_SIZE);
+
+        if(size == 0)
+        {
+            continue;
+        }
+
+        block->lz4 = malloc(size);
+        block->lz4size = size;
+        memcpy(block->lz4, packed, size);
+
+        if(lz4DecompressBlock(out, ISO_BLOCK_SIZE, block->lz4, size) != len || memcmp(ref, out, len) != 0)
+        {
+            fprintf(stderr, "%s: block %d does not decode back from LZ4\n", name, i);
+            free(packed);
+            return 1;
+        }
+    }
+
+    free(packed);
+
+    return 0;
+}
+
+static int fuzz(const struct BlockSet *set, int count, unsigned char *ref, unsigned char *out)
+{
+    unsigned char *data = malloc(ISO_BLOCK_SIZE + BLOCK_PADDING);
+    int i, valid = 0, failures = 0;
+
+    for(i=0; i<count; i++)
+    {
+        const struct Block *block = &set->blocks[rand() % set->count];
+        int flips = 1 + rand() % 3, r, o;
+
+        memset(data, 0, ISO_BLOCK_SIZE + BLOCK_PADDING);
+        memcpy(data, block->data, block->size);
+
+        while(flips-- > 0)
+        {
+            data[rand() % block->size] ^= 1 << (rand() & 7);
+        }
+
+        r = sceKernelDeflateDecompress(ref, ISO_BLOCK_SIZE, data, 0);
+        o = inflateBlock(out, ISO_BLOCK_SIZE, data, &g_state);
+
+        if(o > ISO_BLOCK_SIZE || (r >= 0) != (o >= 0) || (r > 0 && (r != o || memcmp(ref, out, r) != 0)))
+        {
+            if(failures++ == 0)
+            {
+                fprintf(stderr, "fuzz: corrupted block inflates to %d bytes, sceKernelDeflateDecompress %d\n", o, r);
+            }
+        }
+
+        valid += (r >= 0);
+    }
+
+    printf("fuzz: %d corrupted blocks, %d still valid, %d disagreements\n", count, valid, failures);
+    free(data);
+
+    return failures ? 1 : 0;
+}
+
+static int bench(const char *name, const struct BlockSet *set, int rounds, int fuzzCount)
+{
+    unsigned char *ref = malloc(ISO_BLOCK_SIZE);
+    unsigned char *out = malloc(ISO_BLOCK_SIZE);
+    u64 in = 0, total = 0, lz4in = 0, lz4total = 0;
+    double t0, t_ref, t_mod, t_lz4;
+    int i, r, ret;
+
+    ret = verify(name, set, ref, out);
+
+    if(ret == 0)
+    {
+        ret = packLz4(name, set, ref, out);
+    }
+
+    if(ret == 0 && fuzzCount > 0)
+    {
+        ret = fuzz(set, fuzzCount, ref, out);
+    }
+
+    if(ret != 0)
+    {
+        free(ref);
+        free(out);
+        return ret;
+    }
+
+    for(i=0; i<set->count; i++)
+    {
+        in += set->blocks[i].size;
+        total += inflateBlock(out, ISO_BLOCK_SIZE, set->blocks[i].data, &g_state);
+
+        if(set->blocks[i].lz4 != NULL)
+        {
+            lz4in += LZ4_BLOCK_HEADER_SIZE + set->blocks[i].lz4size;
+            lz4total += lz4DecompressBlock(out, ISO_BLOCK_SIZE, set->blocks[i].lz4, set->blocks[i].lz4size);
+        }
+        else
+        {
+            lz4in += set->blocks[i].size;
+            lz4total += inflateBlock(out, ISO_BLOCK_SIZE, set->blocks[i].data, &g_state);
+        }
+    }
+
+    t0 = now();
+
+    for(r=0; r<rounds; r++)
+    {
+        for(i=0; i<set->count; i++)
+        {
+            sceKernelDeflateDecompress(ref, ISO_BLOCK_SIZE, set->blocks[i].data, 0);
+        }
+    }
+
+    t_ref = now() - t0;
+    t0 = now();
+
+    for(r=0; r<rounds; r++)
+    {
+        for(i=0; i<set->count; i++)
+        {
+            inflateBlock(out, ISO_BLOCK_SIZE, set->blocks[i].data, &g_state);
+        }
+    }
+
+    t_mod = now() - t0;
+    t0 = now();
+
+    // what a repacked EBOOT costs, blocks LZ4 cannot shrink stay deflate
+    for(r=0; r<rounds; r++)
+    {
+        for(i=0; i<set->count; i++)
+        {
+            const struct Block *block = &set->blocks[i];
+
+            if(block->lz4 != NULL)
+            {
+                lz4DecompressBlock(out, ISO_BLOCK_SIZE, block->lz4, block->lz4size);
+            }
+            else
+            {
+                inflateBlock(out, ISO_BLOCK_SIZE, block->data, &g_state);
+            }
+        }
+    }
+
+    t_lz4 = now() - t0;
+
+    printf("%s: %d blocks, %llu -> %llu bytes (%.1f%%)\n", name, set->count,
+        (unsigned long long)in, (unsigned long long)total, total ? in * 100.0 / total : 0.0);
+    printf("  sceKernelDeflateDecompress %8.1f MB/s %8.1f us/block\n",
+        total * (double)rounds / t_ref / 1e6, t_ref * 1e6 / rounds / set->count);
+    printf("  inflateBlock               %8.1f MB/s %8.1f us/block\n",
+        total * (double)rounds / t_mod / 1e6, t_mod * 1e6 / rounds / set->count);
+    printf("  repacked as LZ4            %8.1f MB/s %8.1f us/block, %llu bytes (%+.1f%%)\n",
+        lz4total * (double)rounds / t_lz4 / 1e6, t_lz4 * 1e6 / rounds / set->count,
+        (unsigned long long)lz4in, in ? lz4in * 100.0 / in - 100.0 : 0.0);
+
+    free(ref);
+    free(out);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct BlockSet set;
+    int rounds = 20, max = 4096, fuzzCount = 0;
+    int opt, i, ret = 0;
+
+    while((opt = getopt(argc, argv, "r:n:f:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': rounds = atoi(optarg); break;
+            case 'n': max = atoi(optarg); break;
+            case 'f': fuzzCount = atoi(optarg); break;
+            default: fprintf(stderr, "usage: %s [-r rounds] [-n blocks] [-f fuzz] [EBOOT.PBP ...]\n", argv[0]); return 2;
+        }
+    }
+
+    memset(&set, 0, sizeof(set));
+
+    if(optind == argc)
+    {
+        ret = synthBlocks(&set);
+        ret = ret ? ret : bench("synthetic", &set, rounds, fuzzCount);
+        freeBlocks(&set);
+    }
+
+    for(i=optind; i<argc && ret == 0; i++)
+    {
+        ret = loadEboot(&set, argv[i], max);
+
+        if(ret == 0 && set.count == 0)
+        {
+            fprintf(stderr, "%s: no deflated blocks\n", argv[i]);
+            ret = 1;
+        }
+
+        ret = ret ? ret : bench(argv[i], &set, rounds, fuzzCount);
+        freeBlocks(&set);
+    }
+
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * Checks searchMagicWord against every entry of src/libcrypt_table.h and
+ * times it against the string binary search it replaced.
+ *
+ * With -d the lookups go through a libcrypt.db built by tools/mklibcryptdb.py
+ * instead of the embedded table.  Either way a few corrupt databases are
+ * checked afterwards.
+ */
+
+#define _GNU_SOURCE
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pspkernel.h>
+#include <cfwmacros.h>
+
+#include "sim.h"
+
+struct mw {
+    char *discid;
+    u32 mw;
+};
+
+static struct mw magic_words[] = {
+#include "libcrypt_table.h"
+};
+
+extern u32 searchMagicWord(char *discid);
+
+// the lookup searchMagicWord used before the perfect hash, kept for comparison
+static u32 searchMagicWordOld(char *discid)
+{
+    int lower = 0;
+    int upper = NELEMS(magic_words) - 1;
+
+    while(lower < upper - 1)
+    {
+        int cmp1 = strcmp(magic_words[lower].discid, discid);
+        int cmp2 = strcmp(magic_words[upper].discid, discid);
+        if(cmp1 == 0) return magic_words[lower].mw;
+        else if(cmp2 == 0) return magic_words[upper].mw;
+        int half = (upper - lower) / 2;
+        int cmp3 = strcmp(magic_words[lower + half].discid, discid);
+        if(cmp3 == 0) return magic_words[lower + half].mw;
+        else if(cmp3 < 0) lower += half;
+        else upper -= half;
+    }
+
+    return 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the disc id at PSISOIMG+0x400 is followed by more header data, not a terminator
+static void makeSector(char *sector, const char *discid)
+{
+    memset(sector, 0xA5, 0x20);
+    memcpy(sector, discid, strlen(discid));
+}
+
+static int verify(void)
+{
+    static const char *misses[] = { "_SLUS_00594", "_SLES_02085", "_SCES_0031", "SLES_02080_", "_SLES_0208X", "" };
+    char sector[0x20];
+    int failures = 0;
+    size_t i;
+
+    for(i=0; i<NELEMS(magic_words); i++)
+    {
+        u32 mw;
+
+        makeSector(sector, magic_words[i].discid);
+        mw = searchMagicWord(sector);
+
+        if(mw != magic_words[i].mw)
+        {
+            fprintf(stderr, "%s: got %u, expected %u\n", magic_words[i].discid, (uint)mw, (uint)magic_words[i].mw);
+            failures++;
+        }
+    }
+
+    for(i=0; i<NELEMS(misses); i++)
+    {
+        makeSector(sector, misses[i]);
+
+        if(searchMagicWord(sector) != 0)
+        {
+            fprintf(stderr, "%s: expected no magic word\n", misses[i]);
+            failures++;
+        }
+    }
+
+    // different ids sharing a magic word must both resolve
+    makeSector(sector, "_SLES_02080");
+    failures += searchMagicWord(sector) != 40416;
+    makeSector(sector, "_SCES_02080");
+    failures += searchMagicWord(sector) != 40416;
+
+    printf("verified %zu entries and %zu misses: %s\n", NELEMS(magic_words), NELEMS(misses), failures ? "FAILED" : "ok");
+
+    return failures;
+}
+
+static int copyFile(const char *from, const char *to)
+{
+    char buf[4096];
+    FILE *in = fopen(from, "rb");
+    FILE *out = fopen(to, "wb");
+    size_t n;
+
+    if(in == NULL || out == NULL)
+    {
+        perror(in == NULL ? from : to);
+        return -1;
+    }
+
+    while((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    {
+        fwrite(buf, 1, n, out);
+    }
+
+    fclose(in);
+    fclose(out);
+
+    return 0;
+}
+
+// a header that claims more records than its pages hold has to be rejected,
+// one whose records run out before the last page must not read a negative count
+static int writeDb(const char *path, u32 record_count, u16 page_count, u32 data_size)
+{
+    u32 header[8] = { 0x4244434C, 1 | (12 << 16), record_count, 32 | (page_count << 16), 0, 0, 0, 0 };
+    u32 key[2] = { 0, 0 };
+    u8 fill[0x40];
+    FILE *f = fopen(path, "wb");
+    u16 i;
+
+    if(f == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    header[4] = sizeof(header) + page_count * sizeof(key);
+    fwrite(header, 1, sizeof(header), f);
+
+    for(i=0; i<page_count; i++)
+    {
+        fwrite(key, 1, sizeof(key), f);
+    }
+
+    // records that never match a real disc id
+    memset(fill, 0xFF, sizeof(fill));
+
+    while(data_size > 0)
+    {
+        u32 n = data_size < sizeof(fill) ? data_size : sizeof(fill);
+
+        fwrite(fill, 1, n, f);
+        data_size -= n;
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+static int verifyCorruptDb(void *arg)
+{
+    const char *path = arg;
+    char sector[0x20];
+    int failures = 0;
+
+    makeSector(sector, "_SLES_02080");
+
+    // more records than one page can hold, backed by enough data to overrun the read buffer
+    if(writeDb(path, 0xFFFFFFFF, 1, 0x10000) < 0)
+    {
+        return 1;
+    }
+
+    if(searchMagicWord(sector) != 40416)
+    {
+        fprintf(stderr, "record count past the pages: expected the embedded table\n");
+        failures++;
+    }
+
+    // two pages but a single record, the lookup lands on the empty second page
+    if(writeDb(path, 1, 2, 12) < 0)
+    {
+        return 1;
+    }
+
+    if(searchMagicWord(sector) != 0)
+    {
+        fprintf(stderr, "short last page: expected no magic word\n");
+        failures++;
+    }
+
+    printf("corrupt libcrypt.db: %s\n", failures ? "FAILED" : "ok");
+
+    return failures;
+}
+
+// point the simulated memory stick at root, path gets the host path of seplugins/libcrypt.db
+static int setupRoot(const char *root, const char *db, char *path, size_t size)
+{
+    simSetRoot(root);
+    simSetInitFileName("ms0:/PSP/GAME/SLES02080/EBOOT.PBP");
+    mkdir(simHostPath("ms0:/", path, size), 0777);
+    mkdir(simHostPath("ms0:/seplugins", path, size), 0777);
+    simHostPath("ms0:/seplugins/libcrypt.db", path, size);
+
+    return db != NULL ? copyFile(db, path) : 0;
+}
+
+static int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    UNUSED(st);
+    UNUSED(flag);
+    UNUSED(ftw);
+
+    return remove(path);
+}
+
+static int benchMain(void *arg)
+{
+    int rounds = *(int *)arg;
+    char (*sectors)[0x20];
+    volatile u32 sink = 0;
+    double t0, t_new, t_old;
+    size_t i, n = NELEMS(magic_words);
+    int r, old_hits = 0;
+
+    if(verify() != 0)
+    {
+        return 1;
+    }
+
+    sectors = malloc(n * sizeof(*sectors));
+
+    for(i=0; i<n; i++)
+    {
+        makeSector(sectors[i], magic_words[i].discid);
+        old_hits += searchMagicWordOld(magic_words[i].discid) == magic_words[i].mw;
+    }
+
+    t0 = now();
+
+    for(r=0; r<rounds; r++)
+    {
+        for(i=0; i<n; i++)
+        {
+            sink += searchMagicWord(sectors[i]);
+        }
+    }
+
+    t_new = now() - t0;
+    t0 = now();
+
+    for(r=0; r<rounds; r++)
+    {
+        for(i=0; i<n; i++)
+        {
+            sink += searchMagicWordOld(magic_words[i].discid);
+        }
+    }
+
+    t_old = now() - t0;
+
+    printf("old search finds %d/%zu entries\n", old_hits, n);
+    printf("%-16s %10.2f ns/lookup\n", "searchMagicWord", t_new * 1e9 / (rounds * (double)n));
+    printf("%-16s %10.2f ns/lookup\n", "old search", t_old * 1e9 / (rounds * (double)n));
+
+    free(sectors);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char root[] = "/tmp/popcorn-libcrypt-XXXXXX";
+    char path[512];
+    const char *db = NULL;
+    int rounds = 20000;
+    int opt, ret;
+
+    while((opt = getopt(argc, argv, "r:d:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': rounds = atoi(optarg); break;
+            case 'd': db = optarg; break;
+            default: fprintf(stderr, "usage: %s [-r rounds] [-d libcrypt.db]\n", argv[0]); return 2;
+        }
+    }
+
+    if(mkdtemp(root) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    // without -d the root is only set for the corrupt databases, so the table is timed without a failed open
+    if(db != NULL && setupRoot(root, db, path, sizeof(path)) < 0)
+    {
+        return 1;
+    }
+
+    ret = simRunLowStack(benchMain, &rounds);
+
+    if(db != NULL)
+    {
+        printf("libcrypt.db: %u sceIo calls\n", simIoTotal(&g_simIoStats));
+    }
+
+    if(ret == 0 && db == NULL && setupRoot(root, NULL, path, sizeof(path)) < 0)
+    {
+        ret = 1;
+    }
+
+    if(ret == 0)
+    {
+        ret = simRunLowStack(verifyCorruptDb, path);
+    }
+
+    nftw(root, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+    return ret;
+}
@@ -0,0 +1,1108 @@
+/*
+ * Replays a POPS-style EBOOT access trace through popcorn's IoFileMgr hooks
+ * against the simulated kernel and reports throughput and the number of
+ * sceIo* calls each hooked call costs.
+ *
+ * The trace per session is:
+ *   header - PBP header probe, the 4-byte ~ELF probe and the PSAR magic
+ *   reopen - the EBOOT and DOCUMENT.DAT opened and closed with the PGD flag
+ *   psiso  - the large read starting at PSISOIMG+0x400 (config/libcrypt) and
+ *            two short reads that only partly cover the config and the word
+ *   async  - the same PSISOIMG+0x400 read through sceIoReadAsync/WaitAsync
+ *   stream - sequential ISO block reads
+ *   inflate - deflated ISO blocks read and passed to decompressData, the
+ *             whole set twice like a game looping over a streaming region
+ *   memcard - the virtual memory card read in sectors, which is never patched
+ *
+ * The decompressed block cache is sized with -c KiB through popcorn.ini,
+ * -c 0 leaves it disabled. -i inflates with src/inflate.c instead of the
+ * firmware, -l packs the blocks as LZ4 like popcorn_repack does.
+ *
+ * -m us makes every read cost that much plus 20KB/ms like a Memory Stick,
+ * -t us lets the game spend that long on each streamed block, and -p KiB
+ * sets the read ahead window. Together they show how many stream reads the
+ * prefetcher serves from memory and what that does to their latency.
+ */
+
+#define _GNU_SOURCE
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <pspkernel.h>
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "sim.h"
+#include "blockcache.h"
+#include "keystore.h"
+#include "lz4.h"
+#include "lz4pack.h"
+#include "prefetch.h"
+#include "stats.h"
+
+#define EBOOT_PATH "ms0:/PSP/GAME/SLES02080/EBOOT.PBP"
+#define CONFIG_PATH "ms0:/PSP/GAME/SLES02080/CONFIG.BIN"
+#define DOCUMENT_PATH "ms0:/PSP/GAME/SLES02080/DOCUMENT.DAT"
+#define MEMCARD_PATH "ms0:/PSP/SAVEDATA/SLES02080/SCEVMC0.VMP"
+#define KEYS_PATH "ms0:/PSP/GAME/SLES02080/KEYS.BIN"
+#define FAKE_RIF_PATH "ms0:/PSP/LICENSE/XX0000-XXXX00000_00-XXXXXXXXXX000XXX.rif"
+#define ACT_DAT_PATH "flash2:/act.dat"
+
+#define ICON0_OFFSET 0x100
+#define ELF_OFFSET 0x1000
+#define PSAR_OFFSET 0x10000
+#define ISO_OFFSET (PSAR_OFFSET + 0x100000)
+#define ISO_BLOCK_SIZE 0x9300
+#define PSISO_CHUNK_SIZE 0x3C00
+#define CONFIG_SIZE 0x100
+#define PACKED_BLOCKS 16
+#define PACKED_LOOPS 2
+#define MEMCARD_SIZE 0x20080
+#define MEMCARD_READ 0x2000
+#define INI_PATH "ms0:/seplugins/popcorn.ini"
+#define KEY_STORE_PATH "ms0:/seplugins/popcorn.keys"
+#define KEY_STORE_TMP_PATH "ms0:/seplugins/popcorn.keys.tmp"
+#define KEY_STORE_CAPACITY 512
+
+enum {
+    PHASE_HEADER = 0,
+    PHASE_REOPEN,
+    PHASE_PSISO,
+    PHASE_ASYNC,
+    PHASE_STREAM,
+    PHASE_INFLATE,
+    PHASE_MEMCARD,
+    PHASE_COUNT,
+};
+
+static const char *g_phaseNames[PHASE_COUNT] = { "header", "reopen", "psiso", "async", "stream", "inflate", "memcard" };
+
+struct Phase
+{
+    unsigned long hooked;
+    unsigned long sce;
+    double seconds;
+};
+
+struct Bench
+{
+    int sessions;
+    int blocks;
+    int failures;
+    int cacheKb;
+    int builtinInflate;
+    int lz4;
+    int prefetchKb;
+    int thinkUs;
+    struct Phase phases[PHASE_COUNT];
+    unsigned int startupIo[2];
+    unsigned int flushedLines[2]; // written back after patching scePops_Manager and pops
+    double startupSeconds[2];
+    unsigned char config[CONFIG_SIZE];
+    unsigned char *iso; // the blocks of the stream phase
+    unsigned char *plain; // PACKED_BLOCKS inflated blocks
+    unsigned char *memcard;
+    u32 packedOffset[PACKED_BLOCKS];
+    u32 packedSize[PACKED_BLOCKS];
+};
+
+typedef SceUID (*IoOpenFunc)(const char *file, int flag, int mode);
+typedef int (*IoReadFunc)(SceUID fd, unsigned char *buf, int size);
+typedef SceOff (*IoLseekFunc)(SceUID fd, SceOff offset, int whence);
+typedef int (*IoCloseFunc)(SceUID fd);
+typedef int (*IoReadAsyncFunc)(SceUID fd, unsigned char *buf, int size);
+typedef int (*IoWaitAsyncFunc)(SceUID fd, SceInt64 *res);
+typedef int (*IoGetstatFunc)(const char *file, SceIoStat *stat);
+typedef int (*NpDrmGetVersionKeyFunc)(unsigned char *key, unsigned char *act, unsigned char *rif, unsigned int flags);
+
+static IoOpenFunc g_open;
+static IoReadFunc g_read;
+static IoLseekFunc g_lseek;
+static IoCloseFunc g_close;
+static IoReadAsyncFunc g_readAsync;
+static IoWaitAsyncFunc g_waitAsync;
+
+static u32 g_popsManText[1024];
+static u32 g_popsText[4096];
+
+extern int module_start(SceSize args, void *argp);
+extern int g_isCustomPBP;
+extern u32 g_startupTime;
+extern int popcornTraceFlush(void);
+extern int decompressData(unsigned int destSize, const unsigned char *src, unsigned char *dest);
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int writeFile(const char *path, const void *data, size_t size)
+{
+    char host[512];
+    FILE *f = fopen(simHostPath(path, host, sizeof(host)), "wb");
+
+    if(f == NULL)
+    {
+        perror(host);
+        return -1;
+    }
+
+    fwrite(data, 1, size, f);
+    fclose(f);
+
+    return 0;
+}
+
+static void makeDirs(const char *root)
+{
+    const char *dirs[] = { "ms0", "ms0/PSP", "ms0/PSP/GAME", "ms0/PSP/GAME/SLES02080",
+        "ms0/PSP/SAVEDATA", "ms0/PSP/SAVEDATA/SLES02080", "ms0/seplugins", "flash2" };
+    char path[512];
+    size_t i;
+
+    for(i=0; i<NELEMS(dirs); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        mkdir(path, 0777);
+    }
+}
+
+// raw deflate like the blocks of a PSAR, returns the compressed size
+static size_t deflateBlock(const unsigned char *src, unsigned char *dest, size_t size)
+{
+    z_stream zs;
+
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, 9, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = ISO_BLOCK_SIZE;
+    zs.next_out = dest;
+    zs.avail_out = size;
+    deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+
+    return zs.total_out;
+}
+
+// compressible blocks: short runs of a few byte values, like sector data
+static void buildPackedBlocks(struct Bench *b, unsigned char *eboot, size_t offset)
+{
+    int i, j;
+
+    for(i=0; i<PACKED_BLOCKS; i++)
+    {
+        unsigned char *plain = b->plain + i * ISO_BLOCK_SIZE;
+
+        for(j=0; j<ISO_BLOCK_SIZE; j++)
+        {
+            plain[j] = (j & 7) == 0 || (rand() & 3) == 0 ? (unsigned char)(rand() & 0x1F) : plain[j-1];
+        }
+
+        b->packedOffset[i] = offset;
+
+        if(b->lz4)
+        {
+            Lz4BlockHeader header = { LZ4_BLOCK_MAGIC, 0 };
+
+            header.size = lz4PackBlock(plain, ISO_BLOCK_SIZE, eboot + offset + sizeof(header), ISO_BLOCK_SIZE);
+            memcpy(eboot + offset, &header, sizeof(header));
+            b->packedSize[i] = sizeof(header) + header.size;
+        }
+        else
+        {
+            b->packedSize[i] = deflateBlock(plain, eboot + offset, ISO_BLOCK_SIZE + 0x100);
+        }
+
+        offset += (b->packedSize[i] + 15) & ~15;
+    }
+}
+
+static int buildFixture(struct Bench *b)
+{
+    size_t packed = ISO_OFFSET + (size_t)b->blocks * ISO_BLOCK_SIZE;
+    size_t size = packed + PACKED_BLOCKS * (ISO_BLOCK_SIZE + 0x100);
+    unsigned char *eboot = calloc(1, size);
+    u32 *header = (u32 *)eboot;
+    u32 *icon0 = (u32 *)(eboot + ICON0_OFFSET);
+    char ini[192];
+    unsigned char doc[0x100];
+    size_t i;
+    int ret;
+
+    b->plain = malloc(PACKED_BLOCKS * ISO_BLOCK_SIZE);
+    b->iso = malloc(packed - ISO_OFFSET);
+    b->memcard = malloc(MEMCARD_SIZE);
+
+    if(eboot == NULL || b->plain == NULL || b->iso == NULL || b->memcard == NULL)
+    {
+        return -1;
+    }
+
+    header[0] = 0x50425000;
+    header[1] = 0x00010000;
+    header[2] = 0x28;
+    header[3] = ICON0_OFFSET;
+    header[4] = header[5] = header[6] = header[7] = ELF_OFFSET;
+    header[8] = ELF_OFFSET;
+    header[9] = PSAR_OFFSET;
+
+    // minimal valid 80x80 PNG header so popcorn keeps the real icon0
+    icon0[0] = 0x474E5089;
+    icon0[1] = 0x0A1A0A0D;
+    icon0[3] = 0x52444849;
+    icon0[4] = 0x50000000;
+    icon0[5] = 0x50000000;
+
+    memcpy(eboot + ELF_OFFSET, "\x7F" "ELF", 4);
+    memcpy(eboot + PSAR_OFFSET, "PSISOIMG0000", 12);
+    memcpy(eboot + PSAR_OFFSET + 0x400, "_SLES_02080", 11);
+
+    srand(2080);
+
+    for(i=ISO_OFFSET; i<packed; i++)
+    {
+        eboot[i] = (unsigned char)rand();
+    }
+
+    buildPackedBlocks(b, eboot, packed);
+    memcpy(b->iso, eboot + ISO_OFFSET, packed - ISO_OFFSET);
+
+    for(i=0; i<sizeof(b->config); i++)
+    {
+        b->config[i] = (unsigned char)(0xC0 ^ i);
+    }
+
+    ret = writeFile(EBOOT_PATH, eboot, size);
+    free(eboot);
+
+    if(ret == 0)
+    {
+        ret = writeFile(CONFIG_PATH, b->config, sizeof(b->config));
+    }
+
+    // save data that happens to look like the code the loc_6c patch changes
+    for(i=0; i<MEMCARD_SIZE; i++)
+    {
+        b->memcard[i] = (unsigned char)rand();
+    }
+
+    memcpy(b->memcard + 0x41A, "\x10\x27\x19\x22\x41\x10", 6);
+
+    if(ret == 0)
+    {
+        ret = writeFile(MEMCARD_PATH, b->memcard, MEMCARD_SIZE);
+    }
+
+    // a plain manual, like the ones popstation writes
+    if(ret == 0)
+    {
+        memset(doc, 0, sizeof(doc));
+        memcpy(doc, "DOC ", 4);
+        ret = writeFile(DOCUMENT_PATH, doc, sizeof(doc));
+    }
+
+    if(ret == 0)
+    {
+        snprintf(ini, sizeof(ini), "# written by popcorn_bench_read\nblock_cache_kb = %d\nbuiltin_inflate = %d\n"
+            "prefetch_kb = %d\n", b->cacheKb, b->builtinInflate, b->prefetchKb);
+        ret = writeFile(INI_PATH, ini, strlen(ini));
+    }
+
+    return ret;
+}
+
+// fresh, unpatched module texts, like after a reboot
+static void fillModuleTexts(void)
+{
+    u32 *getRifPath = &g_popsManText[92];
+    size_t i;
+
+    for(i=0; i<NELEMS(g_popsManText); i++)
+    {
+        g_popsManText[i] = 0x27BD0000 | (i & 0xFFFF);
+    }
+
+    g_popsManText[100] = 0x34C20016;
+    g_popsManText[200] = JAL(getRifPath);
+    g_popsManText[300] = 0x0000000D;
+
+    for(i=0; i<NELEMS(g_popsText); i++)
+    {
+        g_popsText[i] = 0x8FBF0000 | (i & 0xFFFF);
+    }
+
+    g_popsText[1000] = 0x8E66000C;
+    g_popsText[2000] = 0x00432823;
+    g_popsText[3000] = 0x24050080;
+    g_popsText[3006] = 0x24030001;
+    g_popsText[3500] = 0x14C00014;
+    g_popsText[3501] = 0x24E2FFFF;
+}
+
+static void setupModules(void)
+{
+    fillModuleTexts();
+    simAddModule("scePops_Manager", g_popsManText, sizeof(g_popsManText));
+    simAddModule("pops", g_popsText, sizeof(g_popsText));
+}
+
+static void phaseBegin(SimIoStats *snap, double *t0)
+{
+    *snap = g_simIoStats;
+    *t0 = now();
+}
+
+static void phaseEnd(struct Phase *phase, const SimIoStats *snap, double t0, unsigned long hooked)
+{
+    phase->seconds += now() - t0;
+    phase->hooked += hooked;
+    phase->sce += simIoTotal(&g_simIoStats) - simIoTotal(snap);
+}
+
+static void check(struct Bench *b, int cond, const char *what)
+{
+    if(!cond)
+    {
+        if(b->failures++ == 0)
+        {
+            fprintf(stderr, "check failed: %s\n", what);
+        }
+    }
+}
+
+// the stats exports are syscalls, a user mode caller (bit 31 of k1 set) must
+// not get them to write to kernel memory; the writes would fault here
+static void checkExportBuffers(struct Bench *b)
+{
+    void *kernel = (void *)(uintptr_t)0x88000000;
+    unsigned int k1 = pspSdkSetK1(0x80000000);
+
+    check(b, popcornGetHookStats(0, kernel) < 0, "popcornGetHookStats rejects a kernel buffer from user mode");
+    check(b, popcornGetBlockCacheStats(kernel) < 0, "popcornGetBlockCacheStats rejects a kernel buffer from user mode");
+    check(b, popcornGetPrefetchStats(kernel) < 0, "popcornGetPrefetchStats rejects a kernel buffer from user mode");
+    pspSdkSetK1(k1);
+}
+
+static unsigned char *loadFile(const char *path, size_t *size)
+{
+    char host[512];
+    unsigned char *data = NULL;
+    FILE *f = fopen(simHostPath(path, host, sizeof(host)), "rb");
+    long end;
+
+    if(f == NULL)
+    {
+        return NULL;
+    }
+
+    if(fseek(f, 0, SEEK_END) == 0 && (end = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0 &&
+        (data = malloc(end + 1)) != NULL)
+    {
+        *size = fread(data, 1, end, f);
+    }
+
+    fclose(f);
+
+    return data;
+}
+
+static int fileExists(const char *path)
+{
+    char host[512];
+    struct stat st;
+
+    return stat(simHostPath(path, host, sizeof(host)), &st) == 0;
+}
+
+// content IDs are inserted in an order that isn't sorted, so merges move records around
+static void keyStoreEntry(int n, int version, char *id, unsigned char *key)
+{
+    int i;
+
+    memset(id, 0, KEY_STORE_ID_SIZE);
+    snprintf(id, KEY_STORE_ID_SIZE, "UP9000-SCUS%05d_00-%016d", (n * 7919) % 100000, n);
+
+    for(i=0; i<KEY_STORE_KEY_SIZE; i++)
+    {
+        key[i] = (unsigned char)(n * 31 + i + version * 0x40);
+    }
+}
+
+static int keyStoreHas(int n, int version)
+{
+    char id[KEY_STORE_ID_SIZE];
+    unsigned char key[KEY_STORE_KEY_SIZE], found[KEY_STORE_KEY_SIZE];
+
+    keyStoreEntry(n, version, id, key);
+
+    return keyStoreLookup(id, found) == 0 && memcmp(found, key, sizeof(key)) == 0;
+}
+
+static int keyStoreAdd(int n, int version)
+{
+    char id[KEY_STORE_ID_SIZE];
+    unsigned char key[KEY_STORE_KEY_SIZE];
+
+    keyStoreEntry(n, version, id, key);
+
+    return keyStoreInsert(id, key);
+}
+
+// inserts, lookups and merges of seplugins/popcorn.keys, and stores it must not touch
+static void checkKeyStore(struct Bench *b)
+{
+    unsigned char *before, *after;
+    size_t size, asize;
+    int i, ok;
+
+    sceIoRemove(KEY_STORE_PATH);
+
+    // 40 titles go through two merges and leave a few appended records
+    for(i=0, ok=1; i<40; i++)
+    {
+        ok &= keyStoreAdd(i, 0) == 0;
+    }
+
+    check(b, ok, "key store inserts");
+
+    for(i=0, ok=1; i<40; i++)
+    {
+        ok &= keyStoreHas(i, 0);
+    }
+
+    check(b, ok, "key store lookups after merging");
+    check(b, !keyStoreHas(40, 0), "key store misses a title it doesn't have");
+    check(b, !fileExists(KEY_STORE_TMP_PATH), "key store merge leaves no temporary file");
+
+    // a new key of a sorted title is appended and wins, and keeps winning once merged
+    check(b, keyStoreAdd(3, 1) == 0 && keyStoreHas(3, 1), "key store appended key replaces a sorted one");
+
+    for(i=40, ok=1; i<60; i++)
+    {
+        ok &= keyStoreAdd(i, 0) == 0;
+    }
+
+    check(b, ok && keyStoreHas(3, 1) && keyStoreHas(59, 0) && keyStoreHas(0, 0), "key store merged replacement");
+
+    // fill it up, a new title is refused without rewriting, a known one still takes a new key
+    for(i=60, ok=1; i<KEY_STORE_CAPACITY; i++)
+    {
+        ok &= keyStoreAdd(i, 0) == 0;
+    }
+
+    check(b, ok && keyStoreHas(KEY_STORE_CAPACITY - 1, 0), "key store fills up");
+
+    before = loadFile(KEY_STORE_PATH, &size);
+    check(b, keyStoreAdd(KEY_STORE_CAPACITY, 0) < 0, "full key store refuses a new title");
+    after = loadFile(KEY_STORE_PATH, &asize);
+    check(b, before != NULL && after != NULL && size == asize && memcmp(before, after, size) == 0, "full key store is left as it was");
+    check(b, !fileExists(KEY_STORE_TMP_PATH), "full key store leaves no temporary file");
+    free(after);
+
+    check(b, keyStoreAdd(7, 1) == 0 && keyStoreHas(7, 1), "full key store takes a new key of a title it has");
+
+    // cut off in the middle of the records: lookups past the end miss, inserts leave it alone
+    if(before != NULL)
+    {
+        writeFile(KEY_STORE_PATH, before, size / 2);
+        check(b, !keyStoreHas(KEY_STORE_CAPACITY - 1, 0), "truncated key store misses records past its end");
+        check(b, keyStoreAdd(KEY_STORE_CAPACITY, 0) < 0, "truncated key store refuses inserts");
+        after = loadFile(KEY_STORE_PATH, &asize);
+        check(b, after != NULL && asize == size / 2, "truncated key store is left as it was");
+        free(after);
+
+        // not a key store at all
+        memcpy(before, "XXXX", 4);
+        writeFile(KEY_STORE_PATH, before, size);
+        check(b, !keyStoreHas(0, 0), "corrupt key store misses");
+        check(b, keyStoreAdd(KEY_STORE_CAPACITY, 0) < 0, "corrupt key store refuses inserts");
+        after = loadFile(KEY_STORE_PATH, &asize);
+        check(b, after != NULL && asize == size && memcmp(before, after, size) == 0, "corrupt key store is left as it was");
+        free(after);
+        free(before);
+    }
+
+    sceIoRemove(KEY_STORE_PATH);
+}
+
+// KEYS.BIN is only read once a DRM hook needs the key, and only once: the
+// fixture is a custom EBOOT, it is treated as a signed one for the first part
+static void checkDrm(struct Bench *b)
+{
+    static const unsigned char keys[16] = "popcorn-keys-bin";
+    IoGetstatFunc getstat = (IoGetstatFunc)simFindHook("IoFileMgrForKernel", 0xACE946E8);
+    NpDrmGetVersionKeyFunc getVersionKey = (NpDrmGetVersionKeyFunc)simFindHook("scePspNpDrm_driver", 0x0F9547E6);
+    unsigned char key[16], act[0x1038], rif[0x98];
+    int custom = g_isCustomPBP;
+    SceIoStat stat;
+    SimIoStats snap;
+    SceUID fd;
+    int ret;
+
+    if(getstat == NULL || getVersionKey == NULL)
+    {
+        check(b, 0, "popcorn hooked sceIoGetstat and sceNpDrmGetVersionKey");
+        return;
+    }
+
+    writeFile(KEYS_PATH, keys, sizeof(keys));
+    g_isCustomPBP = 0;
+
+    snap = g_simIoStats;
+    check(b, getstat(EBOOT_PATH, &stat) == 0 && g_simIoStats.getstat - snap.getstat == 1,
+        "other files don't read KEYS.BIN");
+
+    snap = g_simIoStats;
+    ret = getstat(FAKE_RIF_PATH, &stat);
+    check(b, ret == 0 && stat.st_size == 152, "fake RIF stat");
+    check(b, g_simIoStats.getstat - snap.getstat == 1 && g_simIoStats.open - snap.open == 1,
+        "the first DRM hook stats and reads KEYS.BIN");
+
+    snap = g_simIoStats;
+    fd = g_open(FAKE_RIF_PATH, PSP_O_RDONLY, 0777);
+    ret = getstat(ACT_DAT_PATH, &stat);
+    check(b, fd >= 0 && ret == 0 && stat.st_size == 4152, "fake RIF open and act.dat stat");
+    check(b, g_open(ACT_DAT_PATH, PSP_O_RDONLY, 0777) >= 0, "fake act.dat open");
+
+    // the firmware has no key without a RIF, the one from KEYS.BIN stands in
+    memset(key, 0, sizeof(key));
+    ret = getVersionKey(key, act, rif, 0);
+    check(b, ret == 0 && memcmp(key, keys, sizeof(keys)) == 0, "version key from KEYS.BIN");
+    check(b, simIoTotal(&g_simIoStats) == simIoTotal(&snap), "KEYS.BIN is read only once");
+
+    g_isCustomPBP = custom;
+
+    if(custom)
+    {
+        snap = g_simIoStats;
+        check(b, g_open(FAKE_RIF_PATH, PSP_O_RDONLY, 0777) >= 0 && getstat(ACT_DAT_PATH, &stat) == 0 &&
+            simIoTotal(&g_simIoStats) == simIoTotal(&snap), "custom EBOOT fakes the RIF and act.dat without sceIo");
+    }
+}
+
+// the writer runs at a low priority, give it up to a second
+static int waitForFile(const char *path, const unsigned char *data, size_t size)
+{
+    unsigned char *found;
+    size_t found_size = 0;
+    int i, ok = 0;
+
+    for(i=0; i<100 && !ok; i++)
+    {
+        found = loadFile(path, &found_size);
+        ok = found != NULL && found_size == size && memcmp(found, data, size) == 0;
+        free(found);
+
+        if(!ok)
+        {
+            usleep(10000);
+        }
+    }
+
+    return ok;
+}
+
+// a key the firmware derives is written to KEYS.BIN once by the writer
+// thread, asking again for the same key writes nothing. The file is marked
+// after the first write rather than counting writes, which the trace thread
+// also makes.
+static void checkKeysWrite(struct Bench *b)
+{
+    static const unsigned char fresh[16] = "firmware-new-key";
+    static const unsigned char marker[16] = "bench-marked-key";
+    NpDrmGetVersionKeyFunc getVersionKey = (NpDrmGetVersionKeyFunc)simFindHook("scePspNpDrm_driver", 0x0F9547E6);
+    unsigned char key[16], act[0x1038], rif[0x98];
+    int custom = g_isCustomPBP;
+    int ok;
+
+    if(getVersionKey == NULL)
+    {
+        return;
+    }
+
+    g_isCustomPBP = 0;
+    memset(rif, 0, sizeof(rif));
+    simSetVersionKey(fresh);
+
+    ok = getVersionKey(key, act, rif, 0) == 0 && memcmp(key, fresh, sizeof(fresh)) == 0;
+    check(b, ok, "version key from the firmware");
+    check(b, waitForFile(KEYS_PATH, fresh, sizeof(fresh)), "new version key written to KEYS.BIN");
+
+    // pops asks on every boot, the known key must not wake the writer again
+    writeFile(KEYS_PATH, marker, sizeof(marker));
+    ok = getVersionKey(key, act, rif, 0) == 0 && getVersionKey(key, act, rif, 0) == 0;
+    usleep(50000);
+    check(b, ok && waitForFile(KEYS_PATH, marker, sizeof(marker)), "KEYS.BIN written once for a key asked for three times");
+
+    simSetVersionKey(NULL);
+    g_isCustomPBP = custom;
+}
+
+// words of the module texts popcorn patches, everything else must stay as it was
+static const int g_popsManPatched[] = { 200, 300 };
+static const int g_popsPatched[] = { 1002, 3002, 3500, 3501 };
+
+// compares a text with its copy from before patching against the words that
+// should have changed, and checks each changed word's cache lines were flushed
+static void checkPatchJournal(struct Bench *b, const u32 *before, const u32 *after, size_t count,
+    const int *expected, size_t nexpected, const char *what)
+{
+    size_t i, j, changed = 0;
+
+    for(i=0; i<count; i++)
+    {
+        int listed = 0;
+
+        if(before[i] == after[i])
+        {
+            continue;
+        }
+
+        for(j=0; j<nexpected; j++)
+        {
+            listed |= (expected[j] == (int)i);
+        }
+
+        if(!listed || !simCacheFlushed(&after[i], sizeof(after[i])))
+        {
+            fprintf(stderr, "%s: word %zu 0x%08X -> 0x%08X%s\n", what, i, before[i], after[i],
+                listed ? " not flushed" : " not expected to change");
+        }
+
+        check(b, listed, "only the expected words are patched");
+        check(b, simCacheFlushed(&after[i], sizeof(after[i])), "patched words are flushed");
+        changed++;
+    }
+
+    check(b, changed == nexpected, "every expected word is patched");
+    check(b, simFullCacheFlushes() == 0, "no full cache flush");
+}
+
+static void runSession(struct Bench *b, unsigned char *buf)
+{
+    SimIoStats snap;
+    unsigned long hooked;
+    unsigned char *straddle = buf + PSISO_CHUNK_SIZE;
+    SceInt64 res = 0;
+    double t0;
+    SceUID fd;
+    int i;
+
+    phaseBegin(&snap, &t0);
+    fd = g_open(EBOOT_PATH, PSP_O_RDONLY, 0777);
+    g_read(fd, buf, 40);
+    g_lseek(fd, ELF_OFFSET, PSP_SEEK_SET);
+    g_read(fd, buf + 64, 4);
+    check(b, 0 == memcmp(buf + 64, "~PSP", 4), "~ELF -> ~PSP patch");
+    g_lseek(fd, PSAR_OFFSET, PSP_SEEK_SET);
+    g_read(fd, buf, 12);
+    phaseEnd(&b->phases[PHASE_HEADER], &snap, t0, 7);
+
+    phaseBegin(&snap, &t0);
+
+    for(i=0; i<2; i++)
+    {
+        SceUID doc = g_open(DOCUMENT_PATH, 0x40000001, 0777);
+        SceUID eboot = g_open(EBOOT_PATH, 0x40000001, 0777);
+
+        check(b, doc >= 0 && eboot >= 0, "open with the PGD flag");
+        g_close(doc);
+        g_close(eboot);
+    }
+
+    phaseEnd(&b->phases[PHASE_REOPEN], &snap, t0, 8);
+
+    phaseBegin(&snap, &t0);
+    g_lseek(fd, PSAR_OFFSET + 0x400, PSP_SEEK_SET);
+    g_read(fd, buf, PSISO_CHUNK_SIZE);
+    // reads that only cover part of the config and the magic word
+    g_lseek(fd, PSAR_OFFSET + 0x410, PSP_SEEK_SET);
+    g_read(fd, straddle, 0x40);
+    g_lseek(fd, PSAR_OFFSET + 0x12AE, PSP_SEEK_SET);
+    g_read(fd, straddle + 0x40, 4);
+    phaseEnd(&b->phases[PHASE_PSISO], &snap, t0, 6);
+    check(b, 0 == memcmp(buf, "_SLES_02080", 11), "disc id at PSISOIMG+0x400");
+    check(b, 0 == memcmp(buf + 0x20, b->config, sizeof(b->config)), "CONFIG.BIN overlay");
+    check(b, *(u32 *)(buf + 0xEB0) == (40416 ^ 0x72D0EE59), "libcrypt magic word");
+    check(b, 0 == memcmp(straddle, buf + 0x10, 0x40), "CONFIG.BIN overlay on a read straddling it");
+    check(b, 0 == memcmp(straddle + 0x40, buf + 0xEAE, 4), "libcrypt magic word on a read straddling it");
+
+    phaseBegin(&snap, &t0);
+    g_lseek(fd, PSAR_OFFSET + 0x400, PSP_SEEK_SET);
+    memset(buf, 0, PSISO_CHUNK_SIZE);
+    g_readAsync(fd, buf, PSISO_CHUNK_SIZE);
+    g_waitAsync(fd, &res);
+    phaseEnd(&b->phases[PHASE_ASYNC], &snap, t0, 3);
+    check(b, res == PSISO_CHUNK_SIZE, "async read result");
+    check(b, 0 == memcmp(buf + 0x20, b->config, sizeof(b->config)), "CONFIG.BIN overlay on async read");
+
+    phaseBegin(&snap, &t0);
+    hooked = 1;
+    g_lseek(fd, ISO_OFFSET, PSP_SEEK_SET);
+
+    for(i=0; i<b->blocks; i++)
+    {
+        g_read(fd, buf, ISO_BLOCK_SIZE);
+        check(b, 0 == memcmp(buf, b->iso + (size_t)i * ISO_BLOCK_SIZE, ISO_BLOCK_SIZE), "streamed ISO block");
+        hooked++;
+
+        if(b->thinkUs)
+        {
+            usleep(b->thinkUs);
+        }
+    }
+
+    phaseEnd(&b->phases[PHASE_STREAM], &snap, t0, hooked);
+    // reads served from the read ahead window leave the real position behind
+    check(b, g_lseek(fd, 0, PSP_SEEK_CUR) == ISO_OFFSET + (SceOff)b->blocks * ISO_BLOCK_SIZE, "position after the stream");
+
+    phaseBegin(&snap, &t0);
+    hooked = 0;
+
+    for(i=0; i<PACKED_BLOCKS * PACKED_LOOPS; i++)
+    {
+        int block = i % PACKED_BLOCKS;
+        unsigned char *dest = buf + ISO_BLOCK_SIZE + 0x100;
+
+        g_lseek(fd, b->packedOffset[block], PSP_SEEK_SET);
+        g_read(fd, buf, b->packedSize[block]);
+        memset(dest, 0, ISO_BLOCK_SIZE);
+        check(b, decompressData(ISO_BLOCK_SIZE, buf, dest) == 0x92FF, "decompressData returns 0x92FF");
+        check(b, 0 == memcmp(dest, b->plain + block * ISO_BLOCK_SIZE, ISO_BLOCK_SIZE), "inflated block");
+        hooked += 3;
+    }
+
+    phaseEnd(&b->phases[PHASE_INFLATE], &snap, t0, hooked);
+
+    g_close(fd);
+
+    phaseBegin(&snap, &t0);
+    fd = g_open(MEMCARD_PATH, PSP_O_RDONLY, 0777);
+    hooked = 2;
+
+    for(i=0; i*MEMCARD_READ<MEMCARD_SIZE; i++)
+    {
+        int size = MEMCARD_SIZE - i*MEMCARD_READ < MEMCARD_READ ? MEMCARD_SIZE - i*MEMCARD_READ : MEMCARD_READ;
+
+        check(b, g_read(fd, buf, size) == size, "memory card read");
+        check(b, 0 == memcmp(buf, b->memcard + i*MEMCARD_READ, size), "memory card data unchanged");
+        hooked++;
+    }
+
+    g_close(fd);
+    phaseEnd(&b->phases[PHASE_MEMCARD], &snap, t0, hooked);
+}
+
+static int benchMain(void *arg)
+{
+    static u32 before[NELEMS(g_popsText)];
+    struct Bench *b = arg;
+    STMOD_HANDLER handler;
+    unsigned char *buf;
+    SimIoStats snap;
+    double t0;
+    int i;
+
+    // the first start sees a cold probe cache, the second one a warm cache
+    for(i=0; i<2; i++)
+    {
+        sctrlHENSetStartModuleHandler(NULL);
+        fillModuleTexts();
+        memcpy(before, g_popsManText, sizeof(g_popsManText));
+        simResetCacheJournal();
+        snap = g_simIoStats;
+        t0 = now();
+        module_start(0, NULL);
+        b->startupSeconds[i] = now() - t0;
+        b->startupIo[i] = simIoTotal(&g_simIoStats) - simIoTotal(&snap);
+        checkPatchJournal(b, before, g_popsManText, NELEMS(g_popsManText),
+            g_popsManPatched, NELEMS(g_popsManPatched), "scePops_Manager");
+        b->flushedLines[0] = simCacheLinesFlushed();
+    }
+
+    handler = simGetStartModuleHandler();
+
+    if(handler == NULL)
+    {
+        fprintf(stderr, "popcorn did not install a start module handler\n");
+        return 1;
+    }
+
+    memcpy(before, g_popsText, sizeof(g_popsText));
+    simResetCacheJournal();
+    handler(sceKernelFindModuleByName("pops"));
+    checkPatchJournal(b, before, g_popsText, NELEMS(g_popsText), g_popsPatched, NELEMS(g_popsPatched), "pops");
+    b->flushedLines[1] = simCacheLinesFlushed();
+
+    check(b, (g_popsManText[200] & 0xFC000000) == JAL_OPCODE && g_popsManText[200] != JAL(&g_popsManText[92]), "getRifPath call redirected");
+    check(b, g_popsManText[300] == NOP, "popsman firmware check removed");
+    check(b, g_popsText[3002] == 0x24020001, "manual name check patched");
+    check(b, g_popsText[3500] == 0x10000014 && g_popsText[3501] == 0x24E20000, "CDDA index length patched");
+
+    g_open = (IoOpenFunc)simFindHook("IoFileMgrForKernel", 0x109F50BC);
+    g_lseek = (IoLseekFunc)simFindHook("IoFileMgrForKernel", 0x27EB27B8);
+    g_read = (IoReadFunc)simFindHook("IoFileMgrForKernel", 0x6A638D83);
+    g_close = (IoCloseFunc)simFindHook("IoFileMgrForKernel", 0x810C4BC3);
+    g_readAsync = (IoReadAsyncFunc)simFindHook("IoFileMgrForKernel", 0xA0B5A7C2);
+    g_waitAsync = (IoWaitAsyncFunc)simFindHook("IoFileMgrForKernel", 0xE23EEC33);
+
+    if(g_open == NULL || g_lseek == NULL || g_read == NULL || g_close == NULL ||
+        g_readAsync == NULL || g_waitAsync == NULL)
+    {
+        fprintf(stderr, "popcorn did not hook IoFileMgrForKernel\n");
+        return 1;
+    }
+
+    buf = simAllocLow(2 * ISO_BLOCK_SIZE + 0x100);
+
+    if(buf == NULL)
+    {
+        return 1;
+    }
+
+    for(i=0; i<b->sessions; i++)
+    {
+        runSession(b, buf);
+    }
+
+    checkExportBuffers(b);
+    checkKeyStore(b);
+    checkDrm(b);
+    checkKeysWrite(b);
+
+    // only DEBUG=3 builds trace, keep the workdir with -d to decode it
+    if(popcornTraceFlush() >= 0)
+    {
+        printf("trace flushed to ms0:/seplugins/popcorn.trace\n");
+    }
+
+    return 0;
+}
+
+static void report(const struct Bench *b)
+{
+    struct Phase total = { 0, 0, 0.0 };
+    int i;
+
+    printf("module_start: cold %u sceIo calls %.1f us, warm %u sceIo calls %.1f us (g_startupTime %u us)\n",
+        b->startupIo[0], b->startupSeconds[0] * 1e6,
+        b->startupIo[1], b->startupSeconds[1] * 1e6, (unsigned int)g_startupTime);
+    printf("cache lines flushed after patching: scePops_Manager %u, pops %u\n", b->flushedLines[0], b->flushedLines[1]);
+    printf("sessions=%d blocks/session=%d block=0x%X\n", b->sessions, b->blocks, ISO_BLOCK_SIZE);
+    printf("%-8s %12s %12s %12s %14s\n", "phase", "hooked", "sceIo", "sceIo/hook", "calls/sec");
+
+    for(i=0; i<=PHASE_COUNT; i++)
+    {
+        const struct Phase *p = i < PHASE_COUNT ? &b->phases[i] : &total;
+
+        printf("%-8s %12lu %12lu %12.3f %14.0f\n",
+            i < PHASE_COUNT ? g_phaseNames[i] : "total",
+            p->hooked, p->sce,
+            p->hooked ? (double)p->sce / p->hooked : 0.0,
+            p->seconds > 0 ? p->hooked / p->seconds : 0.0);
+
+        if(i < PHASE_COUNT)
+        {
+            total.hooked += p->hooked;
+            total.sce += p->sce;
+            total.seconds += p->seconds;
+        }
+    }
+}
+
+static const char *hookName(u32 nid)
+{
+    static const struct { u32 nid; const char *name; } names[] = {
+        { 0x109F50BC, "sceIoOpen" }, { 0x27EB27B8, "sceIoLseek" }, { 0x68963324, "sceIoLseek32" },
+        { 0x63632449, "sceIoIoctl" }, { 0x6A638D83, "sceIoRead" }, { 0xA0B5A7C2, "sceIoReadAsync" },
+        { 0xE23EEC33, "sceIoWaitAsync" }, { 0x35DBD746, "sceIoWaitAsyncCB" }, { 0x3251EA56, "sceIoPollAsync" },
+        { 0x42EC03AC, "sceIoWrite" }, { 0xACE946E8, "sceIoGetstat" }, { 0x810C4BC3, "sceIoClose" },
+        { 0x0090B2C8, "decompressData" }, { 0x0F9547E6, "NpDrmGetVersionKey" }, { 0x2AB4FE43, "sceMeAudio" },
+    };
+    size_t i;
+
+    for(i=0; i<NELEMS(names); i++)
+    {
+        if(names[i].nid == nid)
+        {
+            return names[i].name;
+        }
+    }
+
+    return "?";
+}
+
+// what an overlay would read through the PopcornPrivate exports
+static void reportHookStats(void)
+{
+    int i, count = popcornGetHookCount();
+
+    printf("%-18s %8s %6s %12s %8s %8s  %s\n", "hook", "calls", "errors", "bytes", "avg us", "max us", "log2 us histogram");
+
+    for(i=0; i<count; i++)
+    {
+        PopcornHookStats stats;
+        int b;
+
+        if(popcornGetHookStats(i, &stats) < 0 || stats.calls == 0)
+        {
+            continue;
+        }
+
+        printf("%-18s %8u %6u %12llu %8.2f %8u ", hookName(stats.nid), stats.calls, stats.errors,
+            (unsigned long long)stats.bytes, (double)stats.total_us / stats.calls, stats.max_us);
+
+        for(b=0; b<STATS_BUCKETS; b++)
+        {
+            if(stats.histogram[b] && b == STATS_BUCKETS - 1)
+            {
+                printf(" >=%u:%u", 1u << (b - 1), stats.histogram[b]);
+            }
+            else if(stats.histogram[b])
+            {
+                printf(" <%u:%u", 1u << b, stats.histogram[b]);
+            }
+        }
+
+        printf("\n");
+    }
+}
+
+static void reportBlockCache(void)
+{
+    PopcornBlockCacheStats stats;
+    u32 inflates;
+    double avg;
+
+    if(popcornGetBlockCacheStats(&stats) < 0)
+    {
+        printf("block cache: disabled, %u blocks inflated in %llu us\n", stats.uncached,
+            (unsigned long long)stats.inflate_us);
+        return;
+    }
+
+    inflates = stats.misses + stats.uncached;
+    avg = inflates ? (double)stats.inflate_us / inflates : 0.0;
+
+    printf("block cache: %u slots, %u hits %u misses %u uncached %u evictions\n",
+        stats.slots, stats.hits, stats.misses, stats.uncached, stats.evictions);
+    printf("block cache: %.1f us per inflate, %.1f us per hit, about %.0f us inflate time saved\n",
+        avg, stats.hits ? (double)stats.hit_us / stats.hits : 0.0, stats.hits * avg - stats.hit_us);
+}
+
+static void reportPrefetch(void)
+{
+    PopcornPrefetchStats stats;
+
+    if(popcornGetPrefetchStats(&stats) < 0)
+    {
+        return;
+    }
+
+    printf("prefetch: %uKB window, %u hits %u misses (%.1f%% hit rate), %u runs, %llu bytes served, %llu read ahead\n",
+        stats.window >> 10, stats.hits, stats.misses,
+        stats.hits + stats.misses ? stats.hits * 100.0 / (stats.hits + stats.misses) : 0.0,
+        stats.restarts, (unsigned long long)stats.served, (unsigned long long)stats.prefetched);
+}
+
+static int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    UNUSED(st);
+    UNUSED(flag);
+    UNUSED(ftw);
+
+    return remove(path);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-s sessions] [-b blocks] [-c cache KiB] [-i] [-l] [-p KiB] [-m us] [-t us] [-d workdir]\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    struct Bench b;
+    char root[] = "/tmp/popcorn-bench-XXXXXX";
+    const char *workdir = NULL;
+    int opt, ret, cleanup = 0;
+
+    memset(&b, 0, sizeof(b));
+    b.sessions = 200;
+    b.blocks = 64;
+    b.cacheKb = 1024;
+
+    while((opt = getopt(argc, argv, "s:b:c:ilp:m:t:d:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 's': b.sessions = atoi(optarg); break;
+            case 'b': b.blocks = atoi(optarg); break;
+            case 'c': b.cacheKb = atoi(optarg); break;
+            case 'i': b.builtinInflate = 1; break;
+            case 'l': b.lz4 = 1; break;
+            case 'p': b.prefetchKb = atoi(optarg); break;
+            case 'm': simSetMediaLatency(atoi(optarg), 20); break;
+            case 't': b.thinkUs = atoi(optarg); break;
+            case 'd': workdir = optarg; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+
+    if(workdir == NULL)
+    {
+        workdir = mkdtemp(root);
+
+        if(workdir == NULL)
+        {
+            perror("mkdtemp");
+            return 1;
+        }
+
+        cleanup = 1;
+    }
+
+    simSetRoot(workdir);
+    makeDirs(workdir);
+
+    if(buildFixture(&b) != 0)
+    {
+        return 1;
+    }
+
+    simSetInitFileName(EBOOT_PATH);
+    setupModules();
+
+    ret = simRunLowStack(benchMain, &b);
+
+    if(ret == 0)
+    {
+        report(&b);
+        reportHookStats();
+        reportBlockCache();
+        reportPrefetch();
+
+        if(b.failures)
+        {
+            fprintf(stderr, "%d check(s) failed\n", b.failures);
+            ret = 1;
+        }
+    }
+
+    if(cleanup)
+    {
+        nftw(workdir, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    return ret;
+}
@@ -0,0 +1,335 @@
+/*
+ * Throughput of sigScan against the if/else compare chain patchPops used
+ * before it, over dumped .text images or a synthetic one.
+ *
+ *   popcorn_bench_scan [-r rounds] [-m MiB] [text.bin ...]
+ *
+ * A dump is the raw .text of a module, e.g. saved from pops with psplink.
+ * Texts are placed below 4GiB like everything the module touches. Both
+ * scanners only count matches here so every round sees the same text.
+ * Filler signatures that never match are added to show how each approach
+ * scales with the size of the signature table.
+ *
+ * sigScanCached is timed on the pops table with an empty location cache
+ * (hash, scan and write back) and with a warm one (hash, lookup, replay).
+ */
+
+#define _GNU_SOURCE
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pspkernel.h>
+#include <cfwmacros.h>
+
+#include "sigscan.h"
+#include "sim.h"
+
+#define POPS_SIGNATURES 5
+#define SYNTH_MATCHES 8
+
+static unsigned long g_matches;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int countMatch(Signature *sig, u32 addr)
+{
+    UNUSED(sig);
+    UNUSED(addr);
+
+    g_matches++;
+
+    return 1;
+}
+
+// filler words are odd "lui $zero" encodings that never show up in real code
+static u32 fillerWord(int i)
+{
+    return 0x3C000000 | (0x1357 * (i + 1) & 0xFFFF);
+}
+
+static int buildSignatures(Signature *sigs, int filler)
+{
+    static const Signature pops[POPS_SIGNATURES] = {
+        { 0x8E66000C, 0xFFFFFFFF, {{ 0 }}, countMatch, 0 },
+        { 0x00432823, 0xFFFFFFFF, {{ 0 }}, countMatch, 0 },
+        { 0x24050080, 0xFFFFFFFF, {{ 24, 0x24030001, 0xFFFFFFFF }}, countMatch, 0 },
+        { 0x14C00014, 0xFFFFFFFF, {{ 4, 0x24E2FFFF, 0xFFFFFFFF }}, countMatch, 0 },
+        { 0x14A00014, 0xFFFFFFFF, {{ 4, 0x24C2FFFF, 0xFFFFFFFF }}, countMatch, 0 },
+    };
+    int i;
+
+    memcpy(sigs, pops, sizeof(pops));
+
+    for(i=0; i<filler; i++)
+    {
+        sigs[POPS_SIGNATURES + i] = (Signature){ fillerWord(i), 0xFFFFFFFF, {{ 0 }}, countMatch, 0 };
+    }
+
+    return POPS_SIGNATURES + filler;
+}
+
+// the loop patchPops ran before sigScan, with the filler appended to the chain
+static unsigned long chainScan(u32 text_addr, u32 text_size, int filler)
+{
+    unsigned long matches = 0;
+    u32 addr;
+
+    for(addr=text_addr; addr<text_addr+text_size; addr+=4)
+    {
+        u32 data = _lw(addr);
+        int i;
+
+        if(data == 0x8E66000C)
+            matches++;
+        else if(data == 0x00432823)
+            matches++;
+        else if(data == 0x24050080 && _lw(addr+24) == 0x24030001)
+            matches++;
+        else if((data == 0x14C00014 && _lw(addr + 4) == 0x24E2FFFF) ||
+            (data == 0x14A00014 && _lw(addr + 4) == 0x24C2FFFF))
+            matches++;
+        else
+        {
+            for(i=0; i<filler; i++)
+            {
+                if(data == fillerWord(i))
+                {
+                    matches++;
+                    break;
+                }
+            }
+        }
+    }
+
+    return matches;
+}
+
+// random words with the pops signatures planted about as often as in pops
+static u32 *synthText(size_t words)
+{
+    u32 *text = simAllocLow(words * 4);
+    u32 seed = 0x2468ACE1;
+    size_t i, step = words / SYNTH_MATCHES;
+
+    for(i=0; i<words; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        text[i] = seed;
+    }
+
+    for(i=0; i+8<words; i+=step)
+    {
+        switch((i / step) % 4)
+        {
+            case 0: text[i] = 0x8E66000C; break;
+            case 1: text[i] = 0x24050080; text[i+6] = 0x24030001; break;
+            case 2: text[i] = 0x14C00014; text[i+1] = 0x24E2FFFF; break;
+            case 3: text[i] = 0x14A00014; text[i+1] = 0x24C2FFFF; break;
+        }
+    }
+
+    return text;
+}
+
+static u32 *loadText(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    u32 *text;
+    long len;
+
+    if(f == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    len = ftell(f) & ~3L;
+    fseek(f, 0, SEEK_SET);
+
+    text = simAllocLow(len > 0 ? len : 4);
+
+    if(len <= 0 || fread(text, 1, len, f) != (size_t)len)
+    {
+        fprintf(stderr, "%s: cannot read\n", path);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+    *size = len;
+
+    return text;
+}
+
+static int benchCache(const char *name, u32 text_addr, size_t size, int rounds)
+{
+    Signature sigs[SIG_MAX_SIGNATURES];
+    int count = buildSignatures(sigs, 0);
+    unsigned long matches[2] = { 0, 0 };
+    unsigned int io[2] = { 0, 0 };
+    double seconds[2] = { 0, 0 };
+    char path[512];
+    int pass, r;
+
+    simHostPath("ms0:/seplugins/popcorn_text.cache", path, sizeof(path));
+
+    for(pass=0; pass<2; pass++)
+    {
+        for(r=0; r<rounds; r++)
+        {
+            SimIoStats snap;
+            double t0;
+
+            if(pass == 0)
+            {
+                remove(path);
+            }
+
+            g_matches = 0;
+            snap = g_simIoStats;
+            t0 = now();
+            sigScanCached(text_addr, size, sigs, count);
+            seconds[pass] += now() - t0;
+            io[pass] += simIoTotal(&g_simIoStats) - simIoTotal(&snap);
+            matches[pass] += g_matches;
+        }
+    }
+
+    if(matches[0] != matches[1])
+    {
+        fprintf(stderr, "%s: the cached locations replay %lu matches, the scan found %lu\n", name, matches[1], matches[0]);
+        return 1;
+    }
+
+    printf("sigScanCached: cold %.1f us %u sceIo calls, warm %.1f us %u sceIo calls\n",
+        seconds[0] * 1e6 / rounds, io[0] / rounds, seconds[1] * 1e6 / rounds, io[1] / rounds);
+
+    return 0;
+}
+
+static int benchText(const char *name, u32 *text, size_t size, int rounds)
+{
+    static const int fillers[] = { 0, 8, 16, SIG_MAX_SIGNATURES - POPS_SIGNATURES };
+    Signature sigs[SIG_MAX_SIGNATURES];
+    u32 text_addr = (u32)(uintptr_t)text;
+    size_t f;
+    int r;
+
+    printf("%s: %zu bytes\n", name, size);
+    printf("%-12s %12s %12s %10s\n", "signatures", "sigScan", "if/else", "matches");
+
+    for(f=0; f<NELEMS(fillers); f++)
+    {
+        int count = buildSignatures(sigs, fillers[f]);
+        unsigned long chain = 0;
+        double t0, t_scan, t_chain;
+
+        g_matches = 0;
+        t0 = now();
+
+        for(r=0; r<rounds; r++)
+        {
+            sigScan(text_addr, size, sigs, count);
+        }
+
+        t_scan = now() - t0;
+        t0 = now();
+
+        for(r=0; r<rounds; r++)
+        {
+            chain += chainScan(text_addr, size, fillers[f]);
+        }
+
+        t_chain = now() - t0;
+
+        if(g_matches != chain)
+        {
+            fprintf(stderr, "%s: sigScan found %lu matches, the compare chain %lu\n", name, g_matches, chain);
+            return 1;
+        }
+
+        printf("%-12d %7.1f MB/s %7.1f MB/s %10lu\n", count,
+            size * (double)rounds / t_scan / 1e6, size * (double)rounds / t_chain / 1e6, chain / rounds);
+    }
+
+    return benchCache(name, text_addr, size, rounds);
+}
+
+static int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    UNUSED(st);
+    UNUSED(flag);
+    UNUSED(ftw);
+
+    return remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+    char root[] = "/tmp/popcorn-scan-XXXXXX";
+    char path[512];
+    int rounds = 20;
+    int mib = 4;
+    int opt, i, ret = 0;
+
+    while((opt = getopt(argc, argv, "r:m:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': rounds = atoi(optarg); break;
+            case 'm': mib = atoi(optarg); break;
+            default: fprintf(stderr, "usage: %s [-r rounds] [-m MiB] [text.bin ...]\n", argv[0]); return 2;
+        }
+    }
+
+    if(mkdtemp(root) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    simSetRoot(root);
+    simSetInitFileName("ms0:/PSP/GAME/SLES02080/EBOOT.PBP");
+    mkdir(simHostPath("ms0:/", path, sizeof(path)), 0777);
+    mkdir(simHostPath("ms0:/seplugins", path, sizeof(path)), 0777);
+
+    if(optind == argc)
+    {
+        size_t size = (size_t)mib << 20;
+        u32 *text = synthText(size / 4);
+
+        ret = benchText("synthetic", text, size, rounds);
+    }
+
+    for(i=optind; i<argc && ret == 0; i++)
+    {
+        size_t size;
+        u32 *text = loadText(argv[i], &size);
+
+        if(text == NULL)
+        {
+            ret = 1;
+            break;
+        }
+
+        ret = benchText(argv[i], text, size, rounds);
+    }
+
+    nftw(root, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+    return ret;
+}
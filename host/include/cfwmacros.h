@@ -0,0 +1,27 @@
+/*
+ * Host-side stand-in for the ark-dev-sdk <cfwmacros.h>.
+ *
+ * Instruction encoders truncate host addresses to 32 bits; the host build is
+ * linked -no-pie so code and data addresses fit.
+ */
+
+#ifndef __CFWMACROS_H__
+#define __CFWMACROS_H__
+
+#include <psptypes.h>
+
+#define NELEMS(a) (sizeof(a) / sizeof(a[0]))
+#define UNUSED(arg) ((void)(arg))
+
+#define NOP 0x00000000
+
+#define J_OPCODE   0x08000000
+#define JAL_OPCODE 0x0C000000
+
+#define J(f)   (J_OPCODE | (((u32)(uintptr_t)(f) & 0x0FFFFFFC) >> 2))
+#define JAL(f) (JAL_OPCODE | (((u32)(uintptr_t)(f) & 0x0FFFFFFC) >> 2))
+
+#define MAKE_JUMP(a, f) _sw(J(f), a)
+#define MAKE_CALL(a, f) _sw(JAL(f), a)
+
+#endif
@@ -0,0 +1,12 @@
+/*
+ * Host-side stand-in for the pspsdk <pspinit.h>.
+ */
+
+#ifndef __PSPINIT_H__
+#define __PSPINIT_H__
+
+#include <pspkernel.h>
+
+char *sceKernelInitFileName(void);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Host-side stand-in for the pspsdk <pspkernel.h>.
+ *
+ * Declares the subset of the kernel and IoFileMgr API popcorn calls. Every
+ * function is implemented by the simulator in host/sim/, which backs the
+ * sceIo* family with a directory on the host filesystem and counts each call.
+ */
+
+#ifndef __PSPKERNEL_H__
+#define __PSPKERNEL_H__
+
+#include <psptypes.h>
+
+#define PSP_O_RDONLY    0x0001
+#define PSP_O_WRONLY    0x0002
+#define PSP_O_RDWR      (PSP_O_RDONLY | PSP_O_WRONLY)
+#define PSP_O_NBLOCK    0x0004
+#define PSP_O_APPEND    0x0100
+#define PSP_O_CREAT     0x0200
+#define PSP_O_TRUNC     0x0400
+#define PSP_O_EXCL      0x0800
+
+#define PSP_SEEK_SET    0
+#define PSP_SEEK_CUR    1
+#define PSP_SEEK_END    2
+
+typedef struct ScePspDateTime
+{
+    unsigned short year;
+    unsigned short month;
+    unsigned short day;
+    unsigned short hour;
+    unsigned short minute;
+    unsigned short second;
+    unsigned int microsecond;
+} ScePspDateTime;
+
+typedef struct SceIoStat
+{
+    SceMode st_mode;
+    unsigned int st_attr;
+    SceOff st_size;
+    ScePspDateTime sce_st_ctime;
+    ScePspDateTime sce_st_atime;
+    ScePspDateTime sce_st_mtime;
+    unsigned int st_private[6];
+} SceIoStat;
+
+typedef struct PspModuleInfo
+{
+    unsigned short modattribute;
+    unsigned char modversion[2];
+    char modname[27];
+    char terminal;
+} PspModuleInfo;
+
+#define PSP_MODULE_INFO(name, attributes, major_version, minor_version) \
+    PspModuleInfo module_info = { attributes, { minor_version, major_version }, name, 0 }
+
+#define _lw(addr)       (*(volatile u32 *)(uintptr_t)(addr))
+#define _sw(val, addr)  (*(volatile u32 *)(uintptr_t)(addr) = (u32)(val))
+#define _lh(addr)       (*(volatile u16 *)(uintptr_t)(addr))
+#define _sh(val, addr)  (*(volatile u16 *)(uintptr_t)(addr) = (u16)(val))
+#define _lb(addr)       (*(volatile u8 *)(uintptr_t)(addr))
+#define _sb(val, addr)  (*(volatile u8 *)(uintptr_t)(addr) = (u8)(val))
+
+/* IoFileMgrForKernel */
+SceUID sceIoOpen(const char *file, int flags, SceMode mode);
+int sceIoClose(SceUID fd);
+int sceIoRead(SceUID fd, void *data, SceSize size);
+int sceIoReadAsync(SceUID fd, void *data, SceSize size);
+int sceIoWrite(SceUID fd, const void *data, SceSize size);
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence);
+int sceIoLseek32(SceUID fd, int offset, int whence);
+int sceIoIoctl(SceUID fd, unsigned int cmd, void *indata, int inlen, void *outdata, int outlen);
+int sceIoGetstat(const char *file, SceIoStat *stat);
+int sceIoRemove(const char *file);
+int sceIoRename(const char *oldname, const char *newname);
+int sceIoWaitAsync(SceUID fd, SceInt64 *res);
+int sceIoWaitAsyncCB(SceUID fd, SceInt64 *res);
+int sceIoPollAsync(SceUID fd, SceInt64 *res);
+
+/* ThreadManForKernel */
+typedef int (*SceKernelThreadEntry)(SceSize args, void *argp);
+
+SceUID sceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int initPriority,
+    int stackSize, SceUInt attr, void *option);
+int sceKernelStartThread(SceUID thid, SceSize arglen, void *argp);
+int sceKernelDelayThread(SceUInt delay);
+SceUID sceKernelCreateSema(const char *name, SceUInt attr, int initVal, int maxVal, void *option);
+int sceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout);
+int sceKernelSignalSema(SceUID semaid, int signal);
+
+/* InterruptManagerForKernel */
+unsigned int sceKernelCpuSuspendIntr(void);
+void sceKernelCpuResumeIntr(unsigned int flags);
+
+/* SysMemForKernel / misc kernel services */
+enum PspMemoryPartitions
+{
+    PSP_MEMORY_PARTITION_KERNEL = 1,
+    PSP_MEMORY_PARTITION_USER = 2,
+};
+
+enum PspSysMemBlockTypes
+{
+    PSP_SMEM_Low = 0,
+    PSP_SMEM_High,
+    PSP_SMEM_Addr,
+};
+
+SceUID sceKernelAllocPartitionMemory(SceUID partitionid, const char *name, int type, SceSize size, void *addr);
+int sceKernelFreePartitionMemory(SceUID blockid);
+void *sceKernelGetBlockHeadAddr(SceUID blockid);
+int sceKernelDevkitVersion(void);
+u32 sceKernelGetSystemTimeLow(void);
+int sceKernelDeflateDecompress(u8 *dest, u32 destSize, const void *src, u32 *unk);
+unsigned int pspSdkSetK1(unsigned int k1);
+
+#endif
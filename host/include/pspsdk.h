@@ -0,0 +1,12 @@
+/*
+ * Host-side stand-in for the pspsdk <pspsdk.h>.
+ */
+
+#ifndef __PSPSDK_H__
+#define __PSPSDK_H__
+
+#include <pspkernel.h>
+
+unsigned int pspSdkGetK1(void);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Host-side stand-in for the pspsdk <psptypes.h>.
+ *
+ * Only the types popcorn actually uses are provided.
+ */
+
+#ifndef __PSPTYPES_H__
+#define __PSPTYPES_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef unsigned int uint;
+
+typedef int SceUID;
+typedef unsigned int SceSize;
+typedef int SceSSize;
+typedef int SceMode;
+typedef int64_t SceOff;
+typedef int64_t SceInt64;
+typedef uint32_t SceUInt;
+
+#endif
@@ -0,0 +1,13 @@
+/*
+ * Host-side stand-in for the pspsdk <psputilsforkernel.h>.
+ */
+
+#ifndef __PSPUTILSFORKERNEL_H__
+#define __PSPUTILSFORKERNEL_H__
+
+#include <pspkernel.h>
+
+void sceKernelDcacheWritebackRange(const void *p, unsigned int size);
+void sceKernelIcacheInvalidateRange(const void *addr, unsigned int size);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * Host-side stand-in for the ark-dev-sdk <systemctrl.h>.
+ *
+ * Hooks installed through sctrlHookImportByNID are recorded by the simulator
+ * instead of patching stubs, so a host program can call them directly.
+ */
+
+#ifndef __SYSTEMCTRL_H__
+#define __SYSTEMCTRL_H__
+
+#include <pspkernel.h>
+
+typedef struct SceModule
+{
+    struct SceModule *next;
+    unsigned short attribute;
+    unsigned char version[2];
+    char modname[27];
+    char terminal;
+    SceUID modid;
+    u32 text_addr;
+    u32 text_size;
+    u32 data_size;
+    u32 bss_size;
+} SceModule;
+
+typedef int (*STMOD_HANDLER)(SceModule *);
+
+SceModule *sceKernelFindModuleByName(const char *modname);
+
+STMOD_HANDLER sctrlHENSetStartModuleHandler(STMOD_HANDLER handler);
+u32 sctrlHENFindFunction(const char *szMod, const char *szLib, u32 nid);
+u32 sctrlFindImportByNID(SceModule *mod, const char *library, u32 nid);
+int sctrlHookImportByNID(SceModule *mod, const char *library, u32 nid, void *func);
+int sctrlGetInitPARAM(const char *paramName, u16 *paramType, u32 *paramLength, void *paramBuffer);
+void sctrlFlushCache(void);
+
+int printk(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,10 @@
+/*
+ * Host-side stand-in for the ark-dev-sdk <systemctrl_private.h>.
+ */
+
+#ifndef __SYSTEMCTRL_PRIVATE_H__
+#define __SYSTEMCTRL_PRIVATE_H__
+
+#include <systemctrl.h>
+
+#endif
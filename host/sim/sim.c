@@ -0,0 +1,1036 @@
+/*
+ * Simulated PSP kernel for host builds of popcorn.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <pspkernel.h>
+#include <pspinit.h>
+#include <psputilsforkernel.h>
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "sim.h"
+
+#define SIM_ERROR_ENOENT    0x80010002
+#define SIM_ERROR_EBADF     0x80010009
+#define SIM_ERROR_EIO       0x80010005
+#define SIM_ERROR_NOASYNC   0x80020329
+#define SIM_ERROR_NOTFOUND  0x8002012E
+#define SIM_ERROR_WAIT_TIMEOUT 0x800201A8
+#define SIM_ERROR_SEMA_OVF  0x800201AE
+#define SIM_ERROR_NO_MEMORY 0x800200D9
+#define SIM_ERROR_BLOCKID   0x800200E3
+
+#define SIM_MAX_FDS 256
+#define SIM_MAX_HOOKS 64
+#define SIM_MAX_MODULES 8
+#define SIM_MAX_CACHE_RANGES 64
+
+struct SimHook
+{
+    char library[32];
+    u32 nid;
+    void *fp;
+};
+
+SimIoStats g_simIoStats;
+
+static char g_root[256] = ".";
+static char g_initFileName[256];
+static STMOD_HANDLER g_startModuleHandler;
+
+static struct SimHook g_hooks[SIM_MAX_HOOKS];
+static int g_hookCount;
+
+static SceModule g_modules[SIM_MAX_MODULES];
+static int g_moduleCount;
+
+typedef struct
+{
+    uintptr_t start;
+    uintptr_t end;
+} SimCacheRange;
+
+static struct
+{
+    SimCacheRange dcache[SIM_MAX_CACHE_RANGES];
+    SimCacheRange icache[SIM_MAX_CACHE_RANGES];
+    unsigned int dcache_count;
+    unsigned int icache_count;
+    unsigned int lines;
+    unsigned int full;
+} g_cacheJournal;
+
+static struct
+{
+    int pending;
+    SceInt64 result;
+} g_async[SIM_MAX_FDS];
+
+static char g_readErrorPath[256];
+static int g_readError[SIM_MAX_FDS];
+
+unsigned int simIoTotal(const SimIoStats *stats)
+{
+    return stats->open + stats->close + stats->read + stats->read_async +
+        stats->write + stats->lseek + stats->ioctl + stats->getstat +
+        stats->remove + stats->rename + stats->wait_async + stats->poll_async;
+}
+
+void simSetRoot(const char *root)
+{
+    snprintf(g_root, sizeof(g_root), "%s", root);
+}
+
+const char *simHostPath(const char *path, char *out, size_t size)
+{
+    const char *colon = strchr(path, ':');
+
+    if(colon == NULL)
+    {
+        snprintf(out, size, "%s/%s", g_root, path);
+    }
+    else
+    {
+        const char *rest = colon + 1;
+
+        while(*rest == '/')
+        {
+            rest++;
+        }
+
+        snprintf(out, size, "%s/%.*s/%s", g_root, (int)(colon - path), path, rest);
+    }
+
+    return out;
+}
+
+void simSetInitFileName(const char *path)
+{
+    snprintf(g_initFileName, sizeof(g_initFileName), "%s", path);
+}
+
+SceModule *simAddModule(const char *name, u32 *text, u32 size)
+{
+    SceModule *mod;
+
+    if(g_moduleCount >= SIM_MAX_MODULES)
+    {
+        return NULL;
+    }
+
+    mod = &g_modules[g_moduleCount++];
+    memset(mod, 0, sizeof(*mod));
+    snprintf(mod->modname, sizeof(mod->modname), "%s", name);
+    mod->modid = 0x1000 + g_moduleCount;
+    mod->text_addr = (u32)(uintptr_t)text;
+    mod->text_size = size;
+
+    return mod;
+}
+
+void *simFindHook(const char *library, u32 nid)
+{
+    int i;
+
+    for(i=0; i<g_hookCount; i++)
+    {
+        if(g_hooks[i].nid == nid && 0 == strcmp(g_hooks[i].library, library))
+        {
+            return g_hooks[i].fp;
+        }
+    }
+
+    return NULL;
+}
+
+STMOD_HANDLER simGetStartModuleHandler(void)
+{
+    return g_startModuleHandler;
+}
+
+void *simAllocLow(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+
+    if(p == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    return p;
+}
+
+struct SimThreadArgs
+{
+    int (*fn)(void *);
+    void *arg;
+    int ret;
+};
+
+static void *simThreadEntry(void *p)
+{
+    struct SimThreadArgs *args = p;
+
+    args->ret = args->fn(args->arg);
+
+    return NULL;
+}
+
+int simRunLowStack(int (*fn)(void *), void *arg)
+{
+    const size_t stack_size = 1024 * 1024;
+    struct SimThreadArgs args = { fn, arg, -1 };
+    pthread_attr_t attr;
+    pthread_t thread;
+    void *stack;
+
+    stack = simAllocLow(stack_size);
+
+    if(stack == NULL)
+    {
+        return -1;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, stack_size);
+
+    if(pthread_create(&thread, &attr, simThreadEntry, &args) != 0)
+    {
+        pthread_attr_destroy(&attr);
+        munmap(stack, stack_size);
+        return -1;
+    }
+
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    munmap(stack, stack_size);
+
+    return args.ret;
+}
+
+/* IoFileMgrForKernel */
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode)
+{
+    char path[512];
+    int oflags = 0;
+    int fd;
+
+    g_simIoStats.open++;
+
+    switch(flags & PSP_O_RDWR)
+    {
+        case PSP_O_WRONLY: oflags = O_WRONLY; break;
+        case PSP_O_RDWR: oflags = O_RDWR; break;
+        default: oflags = O_RDONLY; break;
+    }
+
+    if(flags & PSP_O_CREAT) oflags |= O_CREAT;
+    if(flags & PSP_O_TRUNC) oflags |= O_TRUNC;
+    if(flags & PSP_O_APPEND) oflags |= O_APPEND;
+    if(flags & PSP_O_EXCL) oflags |= O_EXCL;
+
+    fd = open(simHostPath(file, path, sizeof(path)), oflags, mode & 0777);
+
+    if(fd < 0)
+    {
+        return SIM_ERROR_ENOENT;
+    }
+
+    if(fd >= SIM_MAX_FDS)
+    {
+        close(fd);
+        return SIM_ERROR_EBADF;
+    }
+
+    g_async[fd].pending = 0;
+    g_readError[fd] = g_readErrorPath[0] != '\0' && strcmp(file, g_readErrorPath) == 0;
+
+    return fd;
+}
+
+void simSetReadError(const char *path)
+{
+    snprintf(g_readErrorPath, sizeof(g_readErrorPath), "%s", path != NULL ? path : "");
+}
+
+int sceIoClose(SceUID fd)
+{
+    g_simIoStats.close++;
+
+    if(fd < 0 || fd >= SIM_MAX_FDS || close(fd) != 0)
+    {
+        return SIM_ERROR_EBADF;
+    }
+
+    return 0;
+}
+
+static unsigned int g_mediaAccessUs;
+static unsigned int g_mediaKbPerMs;
+static pthread_mutex_t g_mediaLock = PTHREAD_MUTEX_INITIALIZER;
+
+void simSetMediaLatency(unsigned int access_us, unsigned int kb_per_ms)
+{
+    g_mediaAccessUs = access_us;
+    g_mediaKbPerMs = kb_per_ms ? kb_per_ms : 1;
+}
+
+static ssize_t simMediaRead(int fd, void *data, size_t size)
+{
+    ssize_t ret;
+
+    if(g_mediaAccessUs == 0)
+    {
+        return read(fd, data, size);
+    }
+
+    pthread_mutex_lock(&g_mediaLock);
+    ret = read(fd, data, size);
+    usleep(g_mediaAccessUs + (unsigned int)(size * 1000ULL / 1024 / g_mediaKbPerMs));
+    pthread_mutex_unlock(&g_mediaLock);
+
+    return ret;
+}
+
+int sceIoRead(SceUID fd, void *data, SceSize size)
+{
+    ssize_t ret;
+
+    g_simIoStats.read++;
+
+    if(fd >= 0 && fd < SIM_MAX_FDS && g_readError[fd])
+    {
+        return SIM_ERROR_EIO;
+    }
+
+    ret = simMediaRead(fd, data, size);
+
+    return ret < 0 ? (int)SIM_ERROR_EBADF : (int)ret;
+}
+
+int sceIoReadAsync(SceUID fd, void *data, SceSize size)
+{
+    ssize_t ret;
+
+    g_simIoStats.read_async++;
+
+    if(fd < 0 || fd >= SIM_MAX_FDS)
+    {
+        return SIM_ERROR_EBADF;
+    }
+
+    // completes immediately, the result is handed out by the wait/poll calls
+    ret = simMediaRead(fd, data, size);
+    g_async[fd].pending = 1;
+    g_async[fd].result = ret < 0 ? (SceInt64)(int)SIM_ERROR_EBADF : ret;
+
+    return 0;
+}
+
+static int simCollectAsync(SceUID fd, SceInt64 *res)
+{
+    if(fd < 0 || fd >= SIM_MAX_FDS || !g_async[fd].pending)
+    {
+        return SIM_ERROR_NOASYNC;
+    }
+
+    g_async[fd].pending = 0;
+
+    if(res != NULL)
+    {
+        *res = g_async[fd].result;
+    }
+
+    return 0;
+}
+
+int sceIoWaitAsync(SceUID fd, SceInt64 *res)
+{
+    g_simIoStats.wait_async++;
+
+    return simCollectAsync(fd, res);
+}
+
+int sceIoWaitAsyncCB(SceUID fd, SceInt64 *res)
+{
+    g_simIoStats.wait_async++;
+
+    return simCollectAsync(fd, res);
+}
+
+int sceIoPollAsync(SceUID fd, SceInt64 *res)
+{
+    g_simIoStats.poll_async++;
+
+    return simCollectAsync(fd, res);
+}
+
+int sceIoWrite(SceUID fd, const void *data, SceSize size)
+{
+    ssize_t ret;
+
+    g_simIoStats.write++;
+    ret = write(fd, data, size);
+
+    return ret < 0 ? (int)SIM_ERROR_EBADF : (int)ret;
+}
+
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence)
+{
+    off_t ret;
+
+    g_simIoStats.lseek++;
+    ret = lseek(fd, offset, whence);
+
+    return ret < 0 ? (SceOff)(int)SIM_ERROR_EBADF : (SceOff)ret;
+}
+
+int sceIoLseek32(SceUID fd, int offset, int whence)
+{
+    off_t ret;
+
+    g_simIoStats.lseek++;
+    ret = lseek(fd, offset, whence);
+
+    return ret < 0 ? (int)SIM_ERROR_EBADF : (int)ret;
+}
+
+int sceIoIoctl(SceUID fd, unsigned int cmd, void *indata, int inlen, void *outdata, int outlen)
+{
+    UNUSED(fd);
+    UNUSED(cmd);
+    UNUSED(indata);
+    UNUSED(inlen);
+    UNUSED(outdata);
+    UNUSED(outlen);
+
+    g_simIoStats.ioctl++;
+
+    return 0;
+}
+
+static void simDateTime(time_t t, ScePspDateTime *dt)
+{
+    struct tm tm;
+
+    gmtime_r(&t, &tm);
+    dt->year = tm.tm_year + 1900;
+    dt->month = tm.tm_mon + 1;
+    dt->day = tm.tm_mday;
+    dt->hour = tm.tm_hour;
+    dt->minute = tm.tm_min;
+    dt->second = tm.tm_sec;
+    dt->microsecond = 0;
+}
+
+int sceIoGetstat(const char *file, SceIoStat *stat)
+{
+    char path[512];
+    struct stat st;
+
+    g_simIoStats.getstat++;
+
+    if(lstat(simHostPath(file, path, sizeof(path)), &st) != 0)
+    {
+        return SIM_ERROR_ENOENT;
+    }
+
+    memset(stat, 0, sizeof(*stat));
+    stat->st_mode = (S_ISDIR(st.st_mode) ? 0x1000 : 0x2000) | (st.st_mode & 0777);
+    stat->st_attr = S_ISDIR(st.st_mode) ? 0x10 : 0x20;
+    stat->st_size = st.st_size;
+    simDateTime(st.st_ctime, &stat->sce_st_ctime);
+    simDateTime(st.st_atime, &stat->sce_st_atime);
+    simDateTime(st.st_mtime, &stat->sce_st_mtime);
+
+    return 0;
+}
+
+int sceIoRemove(const char *file)
+{
+    char path[512];
+
+    g_simIoStats.remove++;
+
+    return unlink(simHostPath(file, path, sizeof(path))) == 0 ? 0 : (int)SIM_ERROR_ENOENT;
+}
+
+int sceIoRename(const char *oldname, const char *newname)
+{
+    char oldpath[512], newpath[512];
+
+    g_simIoStats.rename++;
+    simHostPath(oldname, oldpath, sizeof(oldpath));
+    simHostPath(newname, newpath, sizeof(newpath));
+
+    return rename(oldpath, newpath) == 0 ? 0 : (int)SIM_ERROR_ENOENT;
+}
+
+/* Kernel services */
+
+// threads are real pthreads, semaphores a counter under a mutex
+#define SIM_MAX_THREADS 8
+#define SIM_MAX_SEMAS 8
+
+static struct
+{
+    SceKernelThreadEntry entry;
+    pthread_t thread;
+    SceSize arglen;
+    void *argp;
+} g_threads[SIM_MAX_THREADS];
+static int g_threadCount;
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+    int max;
+} g_semas[SIM_MAX_SEMAS];
+static int g_semaCount;
+
+static pthread_mutex_t g_intrLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *simKernelThread(void *p)
+{
+    int i = (int)(intptr_t)p;
+
+    g_threads[i].entry(g_threads[i].arglen, g_threads[i].argp);
+
+    return NULL;
+}
+
+SceUID sceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int initPriority,
+    int stackSize, SceUInt attr, void *option)
+{
+    UNUSED(name);
+    UNUSED(initPriority);
+    UNUSED(stackSize);
+    UNUSED(attr);
+    UNUSED(option);
+
+    if(g_threadCount == SIM_MAX_THREADS)
+    {
+        return SIM_ERROR_NOTFOUND;
+    }
+
+    g_threads[g_threadCount].entry = entry;
+
+    return 0x100 + g_threadCount++;
+}
+
+int sceKernelStartThread(SceUID thid, SceSize arglen, void *argp)
+{
+    int i = thid - 0x100;
+
+    if(i < 0 || i >= g_threadCount)
+    {
+        return SIM_ERROR_NOTFOUND;
+    }
+
+    g_threads[i].arglen = arglen;
+    g_threads[i].argp = argp;
+
+    if(pthread_create(&g_threads[i].thread, NULL, simKernelThread, (void *)(intptr_t)i) != 0)
+    {
+        return SIM_ERROR_NOTFOUND;
+    }
+
+    pthread_detach(g_threads[i].thread);
+
+    return 0;
+}
+
+int sceKernelDelayThread(SceUInt delay)
+{
+    usleep(delay);
+
+    return 0;
+}
+
+SceUID sceKernelCreateSema(const char *name, SceUInt attr, int initVal, int maxVal, void *option)
+{
+    UNUSED(name);
+    UNUSED(attr);
+    UNUSED(option);
+
+    if(g_semaCount == SIM_MAX_SEMAS)
+    {
+        return SIM_ERROR_NOTFOUND;
+    }
+
+    pthread_mutex_init(&g_semas[g_semaCount].lock, NULL);
+    pthread_cond_init(&g_semas[g_semaCount].cond, NULL);
+    g_semas[g_semaCount].count = initVal;
+    g_semas[g_semaCount].max = maxVal;
+
+    return 0x200 + g_semaCount++;
+}
+
+int sceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout)
+{
+    int i = semaid - 0x200;
+    struct timespec until;
+    int ret = 0;
+
+    if(i < 0 || i >= g_semaCount)
+    {
+        return SIM_ERROR_NOTFOUND;
+    }
+
+    if(timeout != NULL)
+    {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += *timeout / 1000000;
+        until.tv_nsec += (*timeout % 1000000) * 1000;
+
+        if(until.tv_nsec >= 1000000000)
+        {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&g_semas[i].lock);
+
+    while(g_semas[i].count < signal && ret == 0)
+    {
+        if(timeout != NULL)
+        {
+            ret = pthread_cond_timedwait(&g_semas[i].cond, &g_semas[i].lock, &until);
+        }
+        else
+        {
+            pthread_cond_wait(&g_semas[i].cond, &g_semas[i].lock);
+        }
+    }
+
+    if(g_semas[i].count >= signal)
+    {
+        g_semas[i].count -= signal;
+        ret = 0;
+    }
+    else
+    {
+        ret = SIM_ERROR_WAIT_TIMEOUT;
+    }
+
+    pthread_mutex_unlock(&g_semas[i].lock);
+
+    return ret;
+}
+
+int sceKernelSignalSema(SceUID semaid, int signal)
+{
+    int i = semaid - 0x200;
+
+    if(i < 0 || i >= g_semaCount)
+    {
+        return SIM_ERROR_NOTFOUND;
+    }
+
+    pthread_mutex_lock(&g_semas[i].lock);
+
+    if(g_semas[i].count + signal > g_semas[i].max)
+    {
+        pthread_mutex_unlock(&g_semas[i].lock);
+        return SIM_ERROR_SEMA_OVF;
+    }
+
+    g_semas[i].count += signal;
+    pthread_cond_broadcast(&g_semas[i].cond);
+    pthread_mutex_unlock(&g_semas[i].lock);
+
+    return 0;
+}
+
+// there is only one CPU on the PSP, on the host a global lock stands in
+unsigned int sceKernelCpuSuspendIntr(void)
+{
+    pthread_mutex_lock(&g_intrLock);
+
+    return 1;
+}
+
+void sceKernelCpuResumeIntr(unsigned int flags)
+{
+    UNUSED(flags);
+
+    pthread_mutex_unlock(&g_intrLock);
+}
+
+char *sceKernelInitFileName(void)
+{
+    return g_initFileName[0] ? g_initFileName : NULL;
+}
+
+int sceKernelDevkitVersion(void)
+{
+    return 0x06060010;
+}
+
+u32 sceKernelGetSystemTimeLow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u32)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+static unsigned int g_k1;
+
+unsigned int pspSdkSetK1(unsigned int k1)
+{
+    unsigned int prev = g_k1;
+
+    g_k1 = k1;
+
+    return prev;
+}
+
+unsigned int pspSdkGetK1(void)
+{
+    return g_k1;
+}
+
+// partitions are not modelled, every block is mapped below 4GiB on its own
+#define SIM_MAX_BLOCKS 8
+
+static struct
+{
+    void *addr;
+    SceSize size;
+} g_blocks[SIM_MAX_BLOCKS];
+
+SceUID sceKernelAllocPartitionMemory(SceUID partitionid, const char *name, int type, SceSize size, void *addr)
+{
+    int i;
+
+    UNUSED(partitionid);
+    UNUSED(name);
+    UNUSED(type);
+    UNUSED(addr);
+
+    for(i=0; i<SIM_MAX_BLOCKS; i++)
+    {
+        if(g_blocks[i].addr == NULL)
+        {
+            g_blocks[i].addr = simAllocLow(size);
+
+            if(g_blocks[i].addr == NULL)
+            {
+                return SIM_ERROR_NO_MEMORY;
+            }
+
+            g_blocks[i].size = size;
+
+            return 0x300 + i;
+        }
+    }
+
+    return SIM_ERROR_NO_MEMORY;
+}
+
+int sceKernelFreePartitionMemory(SceUID blockid)
+{
+    int i = blockid - 0x300;
+
+    if(i < 0 || i >= SIM_MAX_BLOCKS || g_blocks[i].addr == NULL)
+    {
+        return SIM_ERROR_BLOCKID;
+    }
+
+    munmap(g_blocks[i].addr, g_blocks[i].size);
+    g_blocks[i].addr = NULL;
+
+    return 0;
+}
+
+void *sceKernelGetBlockHeadAddr(SceUID blockid)
+{
+    int i = blockid - 0x300;
+
+    if(i < 0 || i >= SIM_MAX_BLOCKS)
+    {
+        return NULL;
+    }
+
+    return g_blocks[i].addr;
+}
+
+int sceKernelDeflateDecompress(u8 *dest, u32 destSize, const void *src, u32 *unk)
+{
+    z_stream zs;
+    int ret;
+
+    UNUSED(unk);
+
+    memset(&zs, 0, sizeof(zs));
+
+    if(inflateInit2(&zs, -15) != Z_OK)
+    {
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = 0x7FFFFFFF;
+    zs.next_out = dest;
+    zs.avail_out = destSize;
+    ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+
+    if(ret != Z_STREAM_END)
+    {
+        return -1;
+    }
+
+    return (int)zs.total_out;
+}
+
+SceModule *sceKernelFindModuleByName(const char *modname)
+{
+    int i;
+
+    for(i=0; i<g_moduleCount; i++)
+    {
+        if(0 == strcmp(g_modules[i].modname, modname))
+        {
+            return &g_modules[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* SystemControl */
+
+static unsigned char g_versionKey[16];
+static int g_versionKeySet;
+
+void simSetVersionKey(const unsigned char *key)
+{
+    g_versionKeySet = key != NULL;
+
+    if(key != NULL)
+    {
+        memcpy(g_versionKey, key, sizeof(g_versionKey));
+    }
+}
+
+static int simNpDrmGetVersionKey(unsigned char *key, unsigned char *act, unsigned char *rif, unsigned int flags)
+{
+    UNUSED(act);
+    UNUSED(rif);
+    UNUSED(flags);
+
+    if(!g_versionKeySet)
+    {
+        return 0x80550901;
+    }
+
+    memcpy(key, g_versionKey, sizeof(g_versionKey));
+
+    return 0;
+}
+
+static int simNpDrmCheckRif(unsigned char *rif)
+{
+    UNUSED(rif);
+
+    return 0x80550901;
+}
+
+static int simMeAudio(void *buf, int size)
+{
+    UNUSED(buf);
+
+    return size;
+}
+
+static int simSetCompiledSdkVersion(unsigned int fw_version)
+{
+    UNUSED(fw_version);
+
+    return 0;
+}
+
+static void simImportStub(void)
+{
+}
+
+STMOD_HANDLER sctrlHENSetStartModuleHandler(STMOD_HANDLER handler)
+{
+    STMOD_HANDLER prev = g_startModuleHandler;
+
+    g_startModuleHandler = handler;
+
+    return prev;
+}
+
+u32 sctrlHENFindFunction(const char *szMod, const char *szLib, u32 nid)
+{
+    UNUSED(szMod);
+
+    if(0 == strcmp(szLib, "scePspNpDrm_driver") && nid == 0x0F9547E6)
+        return (u32)(uintptr_t)&simNpDrmGetVersionKey;
+    if(0 == strcmp(szLib, "scePspNpDrm_driver") && nid == 0x9A34AC9F)
+        return (u32)(uintptr_t)&simNpDrmCheckRif;
+    if(0 == strcmp(szLib, "sceMeAudio") && nid == 0x2AB4FE43)
+        return (u32)(uintptr_t)&simMeAudio;
+    if(0 == strcmp(szLib, "SysMemUserForUser") && nid == 0x315AD3A0)
+        return (u32)(uintptr_t)&simSetCompiledSdkVersion;
+
+    return 0;
+}
+
+u32 sctrlFindImportByNID(SceModule *mod, const char *library, u32 nid)
+{
+    UNUSED(mod);
+    UNUSED(library);
+    UNUSED(nid);
+
+    return (u32)(uintptr_t)&simImportStub;
+}
+
+int sctrlHookImportByNID(SceModule *mod, const char *library, u32 nid, void *func)
+{
+    int i;
+
+    UNUSED(mod);
+
+    for(i=0; i<g_hookCount; i++)
+    {
+        if(g_hooks[i].nid == nid && 0 == strcmp(g_hooks[i].library, library))
+        {
+            g_hooks[i].fp = func;
+            return 0;
+        }
+    }
+
+    if(g_hookCount >= SIM_MAX_HOOKS)
+    {
+        return SIM_ERROR_NOTFOUND;
+    }
+
+    snprintf(g_hooks[g_hookCount].library, sizeof(g_hooks[g_hookCount].library), "%s", library);
+    g_hooks[g_hookCount].nid = nid;
+    g_hooks[g_hookCount].fp = func;
+    g_hookCount++;
+
+    return 0;
+}
+
+int sctrlGetInitPARAM(const char *paramName, u16 *paramType, u32 *paramLength, void *paramBuffer)
+{
+    UNUSED(paramName);
+    UNUSED(paramType);
+
+    if(*paramLength > 0)
+    {
+        snprintf(paramBuffer, *paramLength, "SLES02080");
+    }
+
+    return 0;
+}
+
+void sctrlFlushCache(void)
+{
+    g_cacheJournal.full++;
+}
+
+static void simCacheNote(SimCacheRange *ranges, unsigned int *count, const void *addr, unsigned int size)
+{
+    if(*count < SIM_MAX_CACHE_RANGES)
+    {
+        ranges[*count].start = (uintptr_t)addr;
+        ranges[*count].end = (uintptr_t)addr + size;
+        (*count)++;
+    }
+}
+
+void sceKernelDcacheWritebackRange(const void *p, unsigned int size)
+{
+    simCacheNote(g_cacheJournal.dcache, &g_cacheJournal.dcache_count, p, size);
+    g_cacheJournal.lines += (size + 63) / 64;
+}
+
+void sceKernelIcacheInvalidateRange(const void *addr, unsigned int size)
+{
+    simCacheNote(g_cacheJournal.icache, &g_cacheJournal.icache_count, addr, size);
+}
+
+void simResetCacheJournal(void)
+{
+    memset(&g_cacheJournal, 0, sizeof(g_cacheJournal));
+}
+
+static int simCacheCovered(const SimCacheRange *ranges, unsigned int count, uintptr_t addr)
+{
+    unsigned int i;
+
+    for(i=0; i<count; i++)
+    {
+        if(addr >= ranges[i].start && addr < ranges[i].end)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int simCacheFlushed(const void *addr, unsigned int size)
+{
+    uintptr_t p;
+
+    for(p = (uintptr_t)addr; p < (uintptr_t)addr + size; p++)
+    {
+        if(!simCacheCovered(g_cacheJournal.dcache, g_cacheJournal.dcache_count, p) ||
+            !simCacheCovered(g_cacheJournal.icache, g_cacheJournal.icache_count, p))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+unsigned int simFullCacheFlushes(void)
+{
+    return g_cacheJournal.full;
+}
+
+unsigned int simCacheLinesFlushed(void)
+{
+    return g_cacheJournal.lines;
+}
+
+int printk(const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, fmt);
+    ret = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
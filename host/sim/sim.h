@@ -0,0 +1,84 @@
+/*
+ * Simulated PSP kernel for host builds of popcorn.
+ *
+ * The simulator maps device paths such as "ms0:/PSP/GAME/X/EBOOT.PBP" onto
+ * <root>/ms0/PSP/GAME/X/EBOOT.PBP, counts every IoFileMgr call so a host
+ * program can report syscalls per hooked call, and records the hooks popcorn
+ * installs so they can be invoked directly.
+ */
+
+#ifndef __POPCORN_SIM_H__
+#define __POPCORN_SIM_H__
+
+#include <pspkernel.h>
+#include <systemctrl.h>
+
+typedef struct SimIoStats
+{
+    unsigned int open;
+    unsigned int close;
+    unsigned int read;
+    unsigned int read_async;
+    unsigned int write;
+    unsigned int lseek;
+    unsigned int ioctl;
+    unsigned int getstat;
+    unsigned int remove;
+    unsigned int rename;
+    unsigned int wait_async;
+    unsigned int poll_async;
+} SimIoStats;
+
+extern SimIoStats g_simIoStats;
+
+// Total number of IoFileMgr calls recorded in stats
+unsigned int simIoTotal(const SimIoStats *stats);
+
+// Host directory that device roots (ms0, flash2, ...) live under
+void simSetRoot(const char *root);
+
+// Translate a device path into a host path under the root
+const char *simHostPath(const char *path, char *out, size_t size);
+
+// Value returned by sceKernelInitFileName
+void simSetInitFileName(const char *path);
+
+// Register a loaded module whose text lives at text (must be below 4GiB)
+SceModule *simAddModule(const char *name, u32 *text, u32 size);
+
+// Look up the function popcorn hooked into a module import, or NULL
+void *simFindHook(const char *library, u32 nid);
+
+// Handler installed with sctrlHENSetStartModuleHandler
+STMOD_HANDLER simGetStartModuleHandler(void);
+
+// Run fn on a thread whose stack is mapped below 4GiB, so code that casts
+// stack addresses to u32 (as the PSP sources do) keeps working
+int simRunLowStack(int (*fn)(void *), void *arg);
+
+// Allocate memory below 4GiB
+void *simAllocLow(size_t size);
+
+// Make reads behave like a Memory Stick: one at a time, each taking
+// access_us plus the transfer at kb_per_ms. 0 for access_us turns it off.
+void simSetMediaLatency(unsigned int access_us, unsigned int kb_per_ms);
+
+// sceIoRead fails on files opened at path from now on, NULL for none
+void simSetReadError(const char *path);
+
+// Forget the cache maintenance recorded so far
+void simResetCacheJournal(void);
+
+// 1 when every byte of [addr, addr+size) was written back from the dcache
+// and invalidated in the icache since the last reset
+int simCacheFlushed(const void *addr, unsigned int size);
+
+// sctrlFlushCache calls and lines written back by range since the last reset
+unsigned int simFullCacheFlushes(void);
+unsigned int simCacheLinesFlushed(void);
+
+// Key sceNpDrmGetVersionKey hands out from now on, NULL makes it fail like
+// it does without a RIF
+void simSetVersionKey(const unsigned char *key);
+
+#endif
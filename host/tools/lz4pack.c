@@ -0,0 +1,131 @@
+/*
+ * Greedy LZ4 block compressor for popcorn_repack and the benchmarks. ISO
+ * blocks are small, so a single hash table over the block is enough; the
+ * output follows the LZ4 block format end rules (last 5 bytes literals, no
+ * match starting in the last 12 bytes) so any LZ4 decoder accepts it.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lz4pack.h"
+
+#define HASH_BITS 14
+#define MIN_MATCH 4
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+#define MAX_DISTANCE 65535
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+
+    return v;
+}
+
+static uint32_t hash4(const unsigned char *p)
+{
+    return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static unsigned char *writeLength(unsigned char *op, size_t len)
+{
+    while(len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+
+    *op++ = (unsigned char)len;
+
+    return op;
+}
+
+// worst case size of a sequence, checked before writing it
+static size_t sequenceBound(size_t literals)
+{
+    return 1 + literals / 255 + 1 + literals + 2 + 1;
+}
+
+size_t lz4PackBlock(const unsigned char *src, size_t size, unsigned char *dest, size_t capacity)
+{
+    static uint32_t table[1 << HASH_BITS];
+    const unsigned char *ip = src, *anchor = src;
+    const unsigned char *end = src + size;
+    unsigned char *op = dest, *oend = dest + capacity;
+    size_t literals;
+
+    memset(table, 0xFF, sizeof(table));
+
+    while(size >= MATCH_LIMIT + 1 && ip < end - MATCH_LIMIT)
+    {
+        uint32_t h = hash4(ip);
+        uint32_t ref = table[h];
+        const unsigned char *match = src + ref;
+        size_t len, ml;
+
+        table[h] = ip - src;
+
+        if(ref == 0xFFFFFFFF || ip - match > MAX_DISTANCE || read32(match) != read32(ip))
+        {
+            ip++;
+            continue;
+        }
+
+        len = MIN_MATCH;
+
+        while(ip + len < end - LAST_LITERALS && match[len] == ip[len])
+        {
+            len++;
+        }
+
+        literals = ip - anchor;
+
+        if(sequenceBound(literals) + (len - MIN_MATCH) / 255 > (size_t)(oend - op))
+        {
+            return 0;
+        }
+
+        ml = len - MIN_MATCH;
+        *op++ = (unsigned char)(((literals < 15 ? literals : 15) << 4) | (ml < 15 ? ml : 15));
+
+        if(literals >= 15)
+        {
+            op = writeLength(op, literals - 15);
+        }
+
+        memcpy(op, anchor, literals);
+        op += literals;
+        *op++ = (unsigned char)(ip - match);
+        *op++ = (unsigned char)((ip - match) >> 8);
+
+        if(ml >= 15)
+        {
+            op = writeLength(op, ml - 15);
+        }
+
+        ip += len;
+        anchor = ip;
+    }
+
+    literals = end - anchor;
+
+    if(1 + literals / 255 + 1 + literals > (size_t)(oend - op))
+    {
+        return 0;
+    }
+
+    *op++ = (unsigned char)((literals < 15 ? literals : 15) << 4);
+
+    if(literals >= 15)
+    {
+        op = writeLength(op, literals - 15);
+    }
+
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - dest;
+}
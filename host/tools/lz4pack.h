@@ -0,0 +1,10 @@
+#ifndef LZ4PACK_H
+#define LZ4PACK_H
+
+#include <stddef.h>
+
+// Compresses src into an LZ4 block (no frame) as src/lz4.c decodes it.
+// Returns the compressed size, or 0 when it does not fit in capacity.
+size_t lz4PackBlock(const unsigned char *src, size_t size, unsigned char *dest, size_t capacity);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * Repacks the ISO blocks of a single disc PSISOIMG0000 EBOOT as LZ4 blocks
+ * that popcorn's decompressData decodes instead of inflating them.
+ *
+ *   popcorn_repack [-v] in/EBOOT.PBP out/EBOOT.PBP
+ *
+ * Every block is inflated, compressed with LZ4 and written with the header
+ * from src/lz4.h when that is smaller than 0x9300 bytes. Other blocks are
+ * copied unchanged. The index table gets the new offsets and sizes, its other
+ * fields are kept, and whatever follows the ISO data in the PSAR is moved
+ * behind the new data with the PSISOIMG header offset pointing to it
+ * adjusted. Each LZ4 block is decoded again with src/lz4.c before it is
+ * written.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <pspkernel.h>
+
+#include "lz4.h"
+#include "lz4pack.h"
+
+#define ISO_BLOCK_SIZE 0x9300
+#define PSISO_INDEX_OFFSET 0x4000
+#define PSISO_DATA_OFFSET 0x100000
+#define PSISO_TAIL_FIELD 0x0C // PSAR relative offset of the data after the ISO
+#define INDEX_ENTRIES ((PSISO_DATA_OFFSET - PSISO_INDEX_OFFSET) / sizeof(IndexEntry))
+#define ALIGN 16
+
+typedef struct
+{
+    u32 offset; // from PSISOIMG + PSISO_DATA_OFFSET
+    u16 size; // ISO_BLOCK_SIZE = stored
+    u16 flags;
+    u8 hash[16];
+    u8 reserved[8];
+} IndexEntry;
+
+struct Totals
+{
+    int lz4, kept;
+    unsigned long long before, after;
+};
+
+static int inflateRaw(const unsigned char *src, size_t size, unsigned char *dest)
+{
+    z_stream zs;
+    int ret;
+
+    memset(&zs, 0, sizeof(zs));
+
+    if(inflateInit2(&zs, -15) != Z_OK)
+    {
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = size;
+    zs.next_out = dest;
+    zs.avail_out = ISO_BLOCK_SIZE;
+    ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+
+    return ret == Z_STREAM_END ? (int)zs.total_out : -1;
+}
+
+static int copyRange(FILE *in, FILE *out, long offset, long size)
+{
+    unsigned char buf[0x10000];
+
+    fseek(in, offset, SEEK_SET);
+
+    while(size > 0)
+    {
+        size_t n = size < (long)sizeof(buf) ? (size_t)size : sizeof(buf);
+
+        if(fread(buf, 1, n, in) != n || fwrite(buf, 1, n, out) != n)
+        {
+            return -1;
+        }
+
+        size -= n;
+    }
+
+    return 0;
+}
+
+static int pad(FILE *out, long *pos)
+{
+    static const unsigned char zero[ALIGN];
+    long n = (ALIGN - *pos % ALIGN) % ALIGN;
+
+    *pos += n;
+
+    return fwrite(zero, 1, n, out) == (size_t)n ? 0 : -1;
+}
+
+// returns the size written for one block, with entry updated
+static int repackBlock(FILE *in, FILE *out, u32 data, IndexEntry *entry, u32 offset, struct Totals *totals, int verbose)
+{
+    static unsigned char packed[ISO_BLOCK_SIZE], plain[ISO_BLOCK_SIZE], check[ISO_BLOCK_SIZE];
+    static unsigned char lz4[LZ4_BLOCK_HEADER_SIZE + ISO_BLOCK_SIZE];
+    Lz4BlockHeader header;
+    size_t size = entry->size, lz4size;
+    int len;
+
+    fseek(in, data + entry->offset, SEEK_SET);
+
+    if(size == 0 || size > ISO_BLOCK_SIZE || fread(packed, 1, size, in) != size)
+    {
+        return -1;
+    }
+
+    if(size < ISO_BLOCK_SIZE)
+    {
+        len = inflateRaw(packed, size, plain);
+    }
+    else
+    {
+        memcpy(plain, packed, size);
+        len = size;
+    }
+
+    if(len < 0)
+    {
+        return -1;
+    }
+
+    lz4size = lz4PackBlock(plain, len, lz4 + LZ4_BLOCK_HEADER_SIZE, ISO_BLOCK_SIZE - 1 - LZ4_BLOCK_HEADER_SIZE);
+    totals->before += size;
+    entry->offset = offset;
+
+    if(lz4size == 0)
+    {
+        // does not fit, the block stays as it was
+        totals->kept++;
+        totals->after += size;
+
+        return fwrite(packed, 1, size, out) == size ? (int)size : -1;
+    }
+
+    if(lz4DecompressBlock(check, ISO_BLOCK_SIZE, lz4 + LZ4_BLOCK_HEADER_SIZE, lz4size) != len || memcmp(check, plain, len) != 0)
+    {
+        fprintf(stderr, "block at 0x%X does not decode back\n", (unsigned int)offset);
+        return -1;
+    }
+
+    header.magic = LZ4_BLOCK_MAGIC;
+    header.size = lz4size;
+    memcpy(lz4, &header, sizeof(header));
+    entry->size = LZ4_BLOCK_HEADER_SIZE + lz4size;
+    totals->lz4++;
+    totals->after += entry->size;
+
+    if(verbose)
+    {
+        printf("0x%08X %5zu -> %5u\n", (unsigned int)offset, size, entry->size);
+    }
+
+    return fwrite(lz4, 1, entry->size, out) == entry->size ? (int)entry->size : -1;
+}
+
+static int repack(FILE *in, FILE *out, int verbose)
+{
+    static IndexEntry index[INDEX_ENTRIES];
+    struct Totals totals = { 0, 0, 0, 0 };
+    u32 header[10], psar, data, tail_field, count, i;
+    u32 old_end = 0, new_end = 0;
+    long file_size, pos, delta;
+    char magic[12];
+
+    fseek(in, 0, SEEK_END);
+    file_size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    if(fread(header, 1, sizeof(header), in) != sizeof(header) || header[0] != 0x50425000)
+    {
+        fprintf(stderr, "not a PBP\n");
+        return -1;
+    }
+
+    psar = header[9];
+    data = psar + PSISO_DATA_OFFSET;
+    fseek(in, psar, SEEK_SET);
+
+    if(fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, "PSISOIMG0000", 12) != 0)
+    {
+        fprintf(stderr, "no single disc PSISOIMG0000 at 0x%X\n", psar);
+        return -1;
+    }
+
+    fseek(in, psar + PSISO_TAIL_FIELD, SEEK_SET);
+    fread(&tail_field, 1, sizeof(tail_field), in);
+    fseek(in, psar + PSISO_INDEX_OFFSET, SEEK_SET);
+
+    if(fread(index, 1, sizeof(index), in) != sizeof(index))
+    {
+        fprintf(stderr, "index table truncated\n");
+        return -1;
+    }
+
+    for(count=0; count<INDEX_ENTRIES && index[count].size != 0; count++)
+    {
+        if(index[count].offset + index[count].size > old_end)
+        {
+            old_end = index[count].offset + index[count].size;
+        }
+    }
+
+    // everything up to the ISO data, the index is rewritten at the end
+    if(copyRange(in, out, 0, data) < 0)
+    {
+        return -1;
+    }
+
+    pos = 0;
+
+    for(i=0; i<count; i++)
+    {
+        int n = repackBlock(in, out, data, &index[i], pos, &totals, verbose);
+
+        if(n < 0)
+        {
+            fprintf(stderr, "cannot repack block %u\n", i);
+            return -1;
+        }
+
+        pos += n;
+
+        if(pad(out, &pos) < 0)
+        {
+            return -1;
+        }
+    }
+
+    // keep the data after the ISO at the same alignment
+    new_end = pos;
+    old_end = (old_end + ALIGN - 1) & ~(ALIGN - 1);
+    delta = (long)new_end - (long)old_end;
+
+    if(data + old_end < file_size && copyRange(in, out, data + old_end, file_size - data - old_end) < 0)
+    {
+        return -1;
+    }
+
+    if(tail_field >= PSISO_DATA_OFFSET + old_end)
+    {
+        tail_field += delta;
+        fseek(out, psar + PSISO_TAIL_FIELD, SEEK_SET);
+        fwrite(&tail_field, 1, sizeof(tail_field), out);
+    }
+
+    fseek(out, psar + PSISO_INDEX_OFFSET, SEEK_SET);
+
+    if(fwrite(index, 1, sizeof(index), out) != sizeof(index))
+    {
+        return -1;
+    }
+
+    printf("%u blocks: %d LZ4, %d kept, ISO data %llu -> %llu bytes (%+.1f%%)\n", count, totals.lz4, totals.kept,
+        totals.before, totals.after, totals.before ? (totals.after * 100.0 / totals.before) - 100.0 : 0.0);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in, *out;
+    int opt, verbose = 0, ret;
+
+    while((opt = getopt(argc, argv, "vh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'v': verbose = 1; break;
+            default: fprintf(stderr, "usage: %s [-v] in/EBOOT.PBP out/EBOOT.PBP\n", argv[0]); return 2;
+        }
+    }
+
+    if(argc - optind != 2)
+    {
+        fprintf(stderr, "usage: %s [-v] in/EBOOT.PBP out/EBOOT.PBP\n", argv[0]);
+        return 2;
+    }
+
+    in = fopen(argv[optind], "rb");
+
+    if(in == NULL)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    out = fopen(argv[optind+1], "w+b");
+
+    if(out == NULL)
+    {
+        perror(argv[optind+1]);
+        fclose(in);
+        return 1;
+    }
+
+    ret = repack(in, out, verbose);
+    fclose(in);
+
+    if(fclose(out) != 0 || ret < 0)
+    {
+        remove(argv[optind+1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -33,16 +33,32 @@ extern unsigned int g_pspFwVersion;
 extern int g_isCustomPBP;
 extern int g_icon0Status;
 
+// time module_start spent before handing control back to the loader, in us
+u32 g_startupTime;
+
 extern int popcornSyspatch(SceModule *mod);
 extern void patchPopsMgr(void);
-extern void getKeys(void);
+extern int loadProbeCache(void);
+extern void saveProbeCache(void);
+extern int probeEboot(void);
+extern void readDiscOffsets(void);
 extern void readCustomConfig();
+extern void buildPatchPlan(void);
+extern void cacheEbootDecrypted(void);
 extern unsigned int isCustomPBP(void);
 extern int getIcon0Status(void);
 extern void setupPsxFwVersion(unsigned int fw_version);
+extern void loadPluginConfig(void);
+extern void blockCacheInit(void);
+extern void prefetchInit(void);
+#if DEBUG >= 3
+extern void traceInit(void);
+#endif
 
 int module_start(SceSize args, void* argp)
 {
+    u32 start_time = sceKernelGetSystemTimeLow();
+
     #if DEBUG >= 3
     printk("popcorn: init_file = %s\r\n", sceKernelInitFileName());
 
@@ -52,24 +68,42 @@ int module_start(SceSize args, void* argp)
     sctrlGetInitPARAM("DISC_ID", &paramType, &paramLength, g_DiscID);
     
     printk("pops disc id: %s\r\n", g_DiscID);
+
+    // hooks trace to a ring from here on instead of calling printk
+    traceInit();
     #endif
 
     g_pspFwVersion = sceKernelDevkitVersion();
-    
-    getKeys();
+    loadPluginConfig();
+
+    // EBOOTs we have launched before don't need to be parsed again
+    if(loadProbeCache() < 0)
+    {
+        probeEboot();
+        readDiscOffsets();
+        g_isCustomPBP = isCustomPBP();
+        g_icon0Status = getIcon0Status();
+        saveProbeCache();
+    }
+
     readCustomConfig();
-    g_isCustomPBP = isCustomPBP();
-    g_icon0Status = getIcon0Status();
+    buildPatchPlan();
+    prefetchInit();
 
     if(g_isCustomPBP)
     {
         setupPsxFwVersion(g_pspFwVersion);
+        cacheEbootDecrypted();
+        blockCacheInit();
     }
     
     g_previous = sctrlHENSetStartModuleHandler(popcornSyspatch);
     patchPopsMgr();
-    
-    sctrlFlushCache();
+
+    g_startupTime = sceKernelGetSystemTimeLow() - start_time;
+    #if DEBUG >= 3
+    printk("popcorn: module_start took %u us\r\n", (uint)g_startupTime);
+    #endif
     
     return 0;
 }
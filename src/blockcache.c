@@ -0,0 +1,233 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#include <string.h>
+#include <pspkernel.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "blockcache.h"
+#include "config.h"
+#include "stats.h"
+
+// Inflated ISO blocks are kept in fixed size slots of one partition block and
+// evicted least recently used first. A block is only cached when the data it
+// was inflated from lies in the buffer of the last EBOOT read, so it can be
+// keyed by its file offset: the compressed length is never passed to
+// decompressData, a checksum of the source alone could not tell two blocks
+// with the same start apart.
+#define BLOCK_CACHE_SLOT_SIZE 0x9300
+#define BLOCK_CACHE_MAX_SLOTS 128
+#define BLOCK_CACHE_CHECK_SIZE 64
+
+typedef struct
+{
+    BlockCacheKey key;
+    int length; // 0 = empty slot
+    u32 stamp;
+} BlockCacheEntry;
+
+static BlockCacheEntry g_blockEntries[BLOCK_CACHE_MAX_SLOTS];
+static u8 *g_blockData;
+static u32 g_blockSlots;
+static u32 g_blockClock;
+static SceUID g_blockLock = -1;
+static PopcornBlockCacheStats g_blockStats;
+
+static struct
+{
+    u32 buf;
+    u32 pos;
+    u32 size;
+} g_lastRead;
+
+void blockCacheInit(void)
+{
+    int kb = getConfigInt("block_cache_kb", 0);
+    int partition = getConfigInt("block_cache_partition", 1);
+    u32 slots;
+    SceUID block;
+
+    if(g_blockData != NULL || kb <= 0)
+    {
+        return;
+    }
+
+    slots = ((u32)kb << 10) / BLOCK_CACHE_SLOT_SIZE;
+
+    if(slots > BLOCK_CACHE_MAX_SLOTS)
+    {
+        slots = BLOCK_CACHE_MAX_SLOTS;
+    }
+
+    if(slots == 0)
+    {
+        return;
+    }
+
+    block = sceKernelAllocPartitionMemory(partition, "PopcornBlockCache", PSP_SMEM_Low, slots * BLOCK_CACHE_SLOT_SIZE, NULL);
+
+    if(block < 0)
+    {
+        #if DEBUG >= 3
+        printk("%s: cannot allocate %u blocks in partition %d -> 0x%08X\r\n", __func__, (uint)slots, partition, block);
+        #endif
+        return;
+    }
+
+    g_blockLock = sceKernelCreateSema("PopcornBlockCache", 0, 1, 1, NULL);
+    g_blockData = sceKernelGetBlockHeadAddr(block);
+    g_blockSlots = slots;
+    g_blockStats.slots = slots;
+    g_blockStats.slot_size = BLOCK_CACHE_SLOT_SIZE;
+
+    #if DEBUG >= 3
+    printk("%s: %u blocks in partition %d\r\n", __func__, (uint)slots, partition);
+    #endif
+}
+
+void blockCacheNoteRead(const void *buf, u32 pos, int size)
+{
+    if(g_blockData == NULL || size <= 0)
+    {
+        return;
+    }
+
+    g_lastRead.buf = (u32)buf;
+    g_lastRead.pos = pos;
+    g_lastRead.size = size;
+}
+
+static u32 checkBlock(const u8 *src, u32 size)
+{
+    u32 hash = 0x811C9DC5;
+    u32 i;
+
+    for(i=0; i<size; i++)
+    {
+        hash = (hash ^ src[i]) * 0x01000193;
+    }
+
+    return hash;
+}
+
+int blockCacheLookup(const u8 *src, u32 destSize, u8 *dest, BlockCacheKey *key)
+{
+    u32 start, offset, check_size;
+    int i, ret = 0;
+
+    offset = (u32)src - g_lastRead.buf;
+
+    if(g_blockData == NULL || destSize > BLOCK_CACHE_SLOT_SIZE || offset >= g_lastRead.size)
+    {
+        g_blockStats.uncached++;
+        return -1;
+    }
+
+    start = sceKernelGetSystemTimeLow();
+    key->pos = g_lastRead.pos + offset;
+    key->size = destSize;
+    check_size = g_lastRead.size - offset;
+    key->check = checkBlock(src, check_size < BLOCK_CACHE_CHECK_SIZE ? check_size : BLOCK_CACHE_CHECK_SIZE);
+
+    sceKernelWaitSema(g_blockLock, 1, NULL);
+
+    for(i=0; i<g_blockSlots; i++)
+    {
+        BlockCacheEntry *entry = &g_blockEntries[i];
+
+        if(entry->length > 0 && entry->key.pos == key->pos && entry->key.size == key->size && entry->key.check == key->check)
+        {
+            memcpy(dest, g_blockData + i * BLOCK_CACHE_SLOT_SIZE, entry->length);
+            entry->stamp = ++g_blockClock;
+            ret = entry->length;
+            g_blockStats.hits++;
+            g_blockStats.hit_us += sceKernelGetSystemTimeLow() - start;
+            break;
+        }
+    }
+
+    if(ret == 0)
+    {
+        g_blockStats.misses++;
+    }
+
+    sceKernelSignalSema(g_blockLock, 1);
+
+    return ret;
+}
+
+void blockCacheInsert(const BlockCacheKey *key, const u8 *dest, int length, u32 inflate_us)
+{
+    BlockCacheEntry *victim;
+    int i;
+
+    g_blockStats.inflate_us += inflate_us;
+
+    if(key == NULL || length <= 0)
+    {
+        return;
+    }
+
+    sceKernelWaitSema(g_blockLock, 1, NULL);
+    victim = &g_blockEntries[0];
+
+    for(i=0; i<g_blockSlots; i++)
+    {
+        BlockCacheEntry *entry = &g_blockEntries[i];
+
+        if(entry->length == 0)
+        {
+            victim = entry;
+            break;
+        }
+
+        if(entry->stamp - victim->stamp > 0x80000000)
+        {
+            victim = entry;
+        }
+    }
+
+    if(victim->length > 0)
+    {
+        g_blockStats.evictions++;
+    }
+
+    memcpy(g_blockData + (victim - g_blockEntries) * BLOCK_CACHE_SLOT_SIZE, dest, length);
+    victim->key = *key;
+    victim->length = length;
+    victim->stamp = ++g_blockClock;
+
+    sceKernelSignalSema(g_blockLock, 1);
+}
+
+int popcornGetBlockCacheStats(PopcornBlockCacheStats *stats)
+{
+    u32 k1;
+
+    if(stats == NULL || !isK1Buffer(stats, sizeof(*stats)))
+    {
+        return -1;
+    }
+
+    k1 = pspSdkSetK1(0);
+    memcpy(stats, &g_blockStats, sizeof(*stats));
+    pspSdkSetK1(k1);
+
+    return g_blockData != NULL ? 0 : -1;
+}
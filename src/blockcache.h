@@ -0,0 +1,61 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <psptypes.h>
+
+// identifies a compressed ISO block by where it came from in the EBOOT
+typedef struct
+{
+    u32 pos; // file offset of the compressed data
+    u32 check; // hash of its first bytes, in case the read buffer was reused
+    u32 size; // destSize pops asked for
+} BlockCacheKey;
+
+typedef struct
+{
+    u32 slots;
+    u32 slot_size;
+    u32 hits;
+    u32 misses;
+    u32 uncached; // inflated without the cache, src was not in a tracked read
+    u32 evictions;
+    u64 inflate_us; // spent inflating misses and uncached blocks
+    u64 hit_us; // spent copying hits out of the cache
+} PopcornBlockCacheStats;
+
+// sizes the cache from seplugins/popcorn.ini, block_cache_kb = 0 disables it
+void blockCacheInit(void);
+
+// remembers where the data of the last successful read came from
+void blockCacheNoteRead(const void *buf, u32 pos, int size);
+
+// Fills key for src and copies a cached block to dest. Returns the inflated
+// length on a hit, 0 on a miss and -1 when the block cannot be cached.
+int blockCacheLookup(const u8 *src, u32 destSize, u8 *dest, BlockCacheKey *key);
+
+// Accounts the inflate time of a block that missed and stores it, key is NULL
+// when the lookup returned -1.
+void blockCacheInsert(const BlockCacheKey *key, const u8 *dest, int length, u32 inflate_us);
+
+// PopcornPrivate export. The inflate time saved by the cache is about
+// hits * inflate_us / (misses + uncached) - hit_us.
+int popcornGetBlockCacheStats(PopcornBlockCacheStats *stats);
+
+#endif
@@ -0,0 +1,253 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#include <string.h>
+#include <pspkernel.h>
+#include <pspinit.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "config.h"
+
+// seplugins/popcorn.ini, "key = value" lines with integer values in decimal
+// or 0x hex, everything after '#' or ';' is a comment
+#define CONFIG_FILE_NAME "popcorn.ini"
+#define CONFIG_FILE_SIZE 1024
+#define CONFIG_MAX_ENTRIES 16
+#define CONFIG_MAX_KEY 32
+
+// popcorn's own files live in seplugins on the same device as the EBOOT
+#define PLUGIN_DATA_DIR "/seplugins/"
+
+typedef struct
+{
+    char key[CONFIG_MAX_KEY];
+    int value;
+} ConfigEntry;
+
+static ConfigEntry g_config[CONFIG_MAX_ENTRIES];
+static int g_configCount;
+
+static int isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int parseInt(const char *s, int *value)
+{
+    int base = 10, neg = 0, digits = 0;
+    u32 v = 0;
+
+    if(*s == '-')
+    {
+        neg = 1;
+        s++;
+    }
+
+    if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    {
+        base = 16;
+        s += 2;
+    }
+
+    for(;; s++, digits++)
+    {
+        int d;
+
+        if(*s >= '0' && *s <= '9') d = *s - '0';
+        else if(base == 16 && *s >= 'a' && *s <= 'f') d = *s - 'a' + 10;
+        else if(base == 16 && *s >= 'A' && *s <= 'F') d = *s - 'A' + 10;
+        else break;
+
+        v = v * base + d;
+    }
+
+    *value = neg ? -(int)v : (int)v;
+
+    return digits > 0;
+}
+
+static void parseLine(char *line)
+{
+    char *eq, *end, *value;
+    ConfigEntry *entry;
+
+    for(end=line; *end != '\0' && *end != '#' && *end != ';'; end++);
+    *end = '\0';
+    eq = strchr(line, '=');
+
+    if(eq == NULL || g_configCount == CONFIG_MAX_ENTRIES)
+    {
+        return;
+    }
+
+    value = eq + 1;
+
+    while(isBlank(*line)) line++;
+    while(eq > line && isBlank(eq[-1])) eq--;
+    while(isBlank(*value)) value++;
+
+    if(eq == line || eq - line >= CONFIG_MAX_KEY)
+    {
+        return;
+    }
+
+    entry = &g_config[g_configCount];
+    memcpy(entry->key, line, eq - line);
+    entry->key[eq - line] = '\0';
+
+    if(parseInt(value, &entry->value))
+    {
+        g_configCount++;
+    }
+    #if DEBUG >= 3
+    else
+    {
+        printk("%s: bad value for %s\r\n", __func__, entry->key);
+    }
+    #endif
+}
+
+// build the path of one of popcorn's data files on the device the EBOOT was started from
+int getPluginDataPath(const char *name, char *path, unsigned int size)
+{
+    const char *ebootname = sceKernelInitFileName();
+    const char *colon;
+    unsigned int len;
+
+    if(ebootname == NULL || (colon = strchr(ebootname, ':')) == NULL)
+    {
+        return -1;
+    }
+
+    len = colon - ebootname + 1;
+
+    if(len + sizeof(PLUGIN_DATA_DIR) - 1 + strlen(name) + 1 > size)
+    {
+        return -1;
+    }
+
+    memcpy(path, ebootname, len);
+    strcpy(path + len, PLUGIN_DATA_DIR);
+    strcat(path, name);
+
+    return 0;
+}
+
+// write a record of one of popcorn's cache files at offset, a new or short file
+// is grown with zeros first so the slots in between read as empty
+int writeCacheSlot(const char *path, u32 offset, const void *record, u32 size)
+{
+    u8 zeros[0x200];
+    SceUID fd = sceIoOpen(path, PSP_O_WRONLY | PSP_O_CREAT, 0777);
+    int end, ret = -1;
+
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    end = sceIoLseek32(fd, 0, PSP_SEEK_END);
+    memset(zeros, 0, sizeof(zeros));
+
+    while(end >= 0 && (u32)end < offset)
+    {
+        int n = offset - end < sizeof(zeros) ? offset - end : sizeof(zeros);
+
+        if(sceIoWrite(fd, zeros, n) != n)
+        {
+            goto exit;
+        }
+
+        end += n;
+    }
+
+    if(end >= 0 && sceIoLseek32(fd, offset, PSP_SEEK_SET) == (int)offset)
+    {
+        ret = sceIoWrite(fd, record, size) == (int)size ? 0 : -1;
+    }
+
+exit:
+    sceIoClose(fd);
+
+    return ret;
+}
+
+void loadPluginConfig(void)
+{
+    char path[64];
+    char buf[CONFIG_FILE_SIZE + 1];
+    char *line, *next;
+    SceUID fd;
+    int ret;
+
+    g_configCount = 0;
+
+    if(getPluginDataPath(CONFIG_FILE_NAME, path, sizeof(path)) < 0)
+    {
+        return;
+    }
+
+    fd = sceIoOpen(path, PSP_O_RDONLY, 0777);
+
+    if(fd < 0)
+    {
+        return;
+    }
+
+    ret = sceIoRead(fd, buf, CONFIG_FILE_SIZE);
+    sceIoClose(fd);
+
+    if(ret <= 0)
+    {
+        return;
+    }
+
+    buf[ret] = '\0';
+
+    for(line=buf; line!=NULL; line=next)
+    {
+        next = strchr(line, '\n');
+
+        if(next != NULL)
+        {
+            *next++ = '\0';
+        }
+
+        parseLine(line);
+    }
+
+    #if DEBUG >= 3
+    printk("%s: %d options\r\n", __func__, g_configCount);
+    #endif
+}
+
+int getConfigInt(const char *key, int def)
+{
+    int i;
+
+    for(i=0; i<g_configCount; i++)
+    {
+        if(strcmp(g_config[i].key, key) == 0)
+        {
+            return g_config[i].value;
+        }
+    }
+
+    return def;
+}
@@ -0,0 +1,38 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <psptypes.h>
+
+// reads seplugins/popcorn.ini, missing keys keep their defaults
+void loadPluginConfig(void);
+
+// value of key in popcorn.ini, def when it isn't set
+int getConfigInt(const char *key, int def);
+
+// builds the path of name in seplugins on the device the EBOOT was started
+// from, returns -1 when it doesn't fit in size
+int getPluginDataPath(const char *name, char *path, unsigned int size);
+
+// writes size bytes of record at offset of the cache file at path, creating
+// it or growing it with empty slots as needed; returns -1 on failure
+int writeCacheSlot(const char *path, u32 offset, const void *record, u32 size);
+
+#endif
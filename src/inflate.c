@@ -0,0 +1,560 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#include <string.h>
+#include <pspkernel.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "inflate.h"
+
+// A raw deflate (RFC 1951) decoder for PSAR blocks. Huffman codes are decoded
+// through a lookup table on the low bits of a 32 bit bit buffer, matches are
+// copied a word at a time when they do not overlap within a word.
+#define INFLATE_ERROR_DATA -1
+#define INFLATE_ERROR_OUTPUT -2
+
+typedef struct
+{
+    const u8 *in;
+    u32 bitbuf;
+    int bitcnt;
+    u8 *out;
+    u8 *out_start;
+    u8 *out_end;
+} InflateStream;
+
+static const u16 g_lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const u8 g_lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const u16 g_distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const u8 g_distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// order of the code length code lengths in a dynamic block header
+static const u8 g_codeLengthOrder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static InflateState g_inflateState;
+static SceUID g_inflateLock = -1;
+
+// Loads a little endian word and keeps the whole bytes of it that fit, at
+// least 24 bits. The bits above bitcnt come from the next byte and are loaded
+// again unchanged on the next refill.
+#define REFILL(in, bitbuf, bitcnt) \
+    do \
+    { \
+        u32 word; \
+        memcpy(&word, in, 4); \
+        bitbuf |= word << bitcnt; \
+        in += (31 - bitcnt) >> 3; \
+        bitcnt |= 24; \
+    } while(0)
+
+static inline void refill(InflateStream *s)
+{
+    REFILL(s->in, s->bitbuf, s->bitcnt);
+}
+
+static inline u32 getBits(InflateStream *s, int n)
+{
+    u32 v = s->bitbuf & ((1 << n) - 1);
+
+    s->bitbuf >>= n;
+    s->bitcnt -= n;
+
+    return v;
+}
+
+// Returns the number of codes missing for a complete code, negative when
+// lengths describe more codes than there are. Incomplete codes are allowed,
+// their unused codes decode to an error.
+static int buildHuffman(InflateHuffman *h, const u8 *lengths, int n, int bits)
+{
+    u16 offsets[16];
+    int len, sym, left, index, i;
+    u32 code;
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->table, 0, sizeof(h->table[0]) << bits);
+    h->bits = bits;
+
+    for(sym=0; sym<n; sym++)
+    {
+        h->count[lengths[sym]]++;
+    }
+
+    left = 1;
+
+    for(len=1; len<16; len++)
+    {
+        left = (left << 1) - h->count[len];
+
+        if(left < 0)
+        {
+            return left;
+        }
+    }
+
+    offsets[1] = 0;
+
+    for(len=1; len<15; len++)
+    {
+        offsets[len+1] = offsets[len] + h->count[len];
+    }
+
+    for(sym=0; sym<n; sym++)
+    {
+        if(lengths[sym] != 0)
+        {
+            h->symbol[offsets[lengths[sym]]++] = sym;
+        }
+    }
+
+    // canonical codes are assigned in symbol order within each length, the
+    // table is indexed by the code bit reversed since deflate sends it MSB first
+    code = 0;
+    index = 0;
+
+    for(len=1; len<=bits; len++)
+    {
+        for(i=0; i<h->count[len]; i++)
+        {
+            u32 rev = 0, c = code++;
+            int b;
+
+            for(b=0; b<len; b++)
+            {
+                rev = (rev << 1) | (c & 1);
+                c >>= 1;
+            }
+
+            for(; rev<(1u << bits); rev+=(1 << len))
+            {
+                h->table[rev] = (h->symbol[index] << 4) | len;
+            }
+
+            index++;
+        }
+
+        code <<= 1;
+    }
+
+    return left;
+}
+
+// codes longer than the table, one bit at a time from the canonical code
+static int decodeSlow(InflateStream *s, const InflateHuffman *h)
+{
+    int code = 0, first = 0, index = 0, len;
+
+    for(len=1; len<16; len++)
+    {
+        int count = h->count[len];
+
+        code |= getBits(s, 1);
+
+        if(code - count < first)
+        {
+            return h->symbol[index + (code - first)];
+        }
+
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return INFLATE_ERROR_DATA;
+}
+
+static inline int decode(InflateStream *s, const InflateHuffman *h)
+{
+    u32 entry = h->table[s->bitbuf & ((1 << h->bits) - 1)];
+
+    if(entry == 0)
+    {
+        return decodeSlow(s, h);
+    }
+
+    s->bitbuf >>= entry & 15;
+    s->bitcnt -= entry & 15;
+
+    return entry >> 4;
+}
+
+static inline void copyMatch(u8 *out, u32 dist, u32 len)
+{
+    const u8 *from = out - dist;
+
+    if(dist == 1)
+    {
+        memset(out, *from, len);
+        return;
+    }
+
+    if(dist >= 4)
+    {
+        while(len >= 4)
+        {
+            u32 word;
+
+            memcpy(&word, from, 4);
+            memcpy(out, &word, 4);
+            from += 4;
+            out += 4;
+            len -= 4;
+        }
+    }
+
+    while(len-- > 0)
+    {
+        *out++ = *from++;
+    }
+}
+
+// table lookup on the locals of inflateCodes, the stream is only synced for
+// codes longer than the table
+#define DECODE(h, mask, sym) \
+    do \
+    { \
+        u32 entry = (h)->table[bitbuf & (mask)]; \
+        if(entry != 0) \
+        { \
+            bitbuf >>= entry & 15; \
+            bitcnt -= entry & 15; \
+            sym = entry >> 4; \
+        } \
+        else \
+        { \
+            s->bitbuf = bitbuf; \
+            s->bitcnt = bitcnt; \
+            sym = decodeSlow(s, h); \
+            bitbuf = s->bitbuf; \
+            bitcnt = s->bitcnt; \
+        } \
+    } while(0)
+
+#define BITS(n) (bitbuf & ((1 << (n)) - 1))
+#define DROP(n) do { bitbuf >>= (n); bitcnt -= (n); } while(0)
+
+// The hot loop keeps the stream in locals, stores through out could alias it
+// otherwise.
+static int inflateCodes(InflateStream *s, const InflateHuffman *lit, const InflateHuffman *dist)
+{
+    const u8 *in = s->in;
+    u32 bitbuf = s->bitbuf;
+    int bitcnt = s->bitcnt;
+    u8 *out = s->out;
+    u8 *out_start = s->out_start;
+    u8 *out_end = s->out_end;
+    u32 lit_mask = (1 << lit->bits) - 1;
+    u32 dist_mask = (1 << dist->bits) - 1;
+    int ret;
+
+    while(1)
+    {
+        int sym;
+        u32 len, d;
+
+        REFILL(in, bitbuf, bitcnt);
+        DECODE(lit, lit_mask, sym);
+
+        if(sym < 256)
+        {
+            if(sym < 0 || out == out_end)
+            {
+                ret = sym < 0 ? sym : INFLATE_ERROR_OUTPUT;
+                break;
+            }
+
+            *out++ = sym;
+            continue;
+        }
+
+        if(sym == 256)
+        {
+            ret = 0;
+            break;
+        }
+
+        sym -= 257;
+
+        if(sym >= 29)
+        {
+            ret = INFLATE_ERROR_DATA;
+            break;
+        }
+
+        len = g_lengthBase[sym] + BITS(g_lengthExtra[sym]);
+        DROP(g_lengthExtra[sym]);
+        REFILL(in, bitbuf, bitcnt);
+        DECODE(dist, dist_mask, sym);
+
+        if(sym < 0 || sym >= 30)
+        {
+            ret = INFLATE_ERROR_DATA;
+            break;
+        }
+
+        REFILL(in, bitbuf, bitcnt);
+        d = g_distBase[sym] + BITS(g_distExtra[sym]);
+        DROP(g_distExtra[sym]);
+
+        if(d > out - out_start)
+        {
+            ret = INFLATE_ERROR_DATA;
+            break;
+        }
+
+        if(len > out_end - out)
+        {
+            ret = INFLATE_ERROR_OUTPUT;
+            break;
+        }
+
+        copyMatch(out, d, len);
+        out += len;
+    }
+
+    s->in = in;
+    s->bitbuf = bitbuf;
+    s->bitcnt = bitcnt;
+    s->out = out;
+
+    return ret;
+}
+
+static int inflateStored(InflateStream *s)
+{
+    u32 len;
+
+    // back to the byte boundary, bytes still in the buffer are given back
+    getBits(s, s->bitcnt & 7);
+    s->in -= s->bitcnt >> 3;
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+
+    len = s->in[0] | (s->in[1] << 8);
+
+    if((len ^ 0xFFFF) != (u32)(s->in[2] | (s->in[3] << 8)))
+    {
+        return INFLATE_ERROR_DATA;
+    }
+
+    if(len > s->out_end - s->out)
+    {
+        return INFLATE_ERROR_OUTPUT;
+    }
+
+    memcpy(s->out, s->in + 4, len);
+    s->in += 4 + len;
+    s->out += len;
+
+    return 0;
+}
+
+static int inflateFixed(InflateStream *s, InflateState *state)
+{
+    u8 lengths[288];
+    int i;
+
+    for(i=0; i<144; i++) lengths[i] = 8;
+    for(; i<256; i++) lengths[i] = 9;
+    for(; i<280; i++) lengths[i] = 7;
+    for(; i<288; i++) lengths[i] = 8;
+
+    buildHuffman(&state->lit, lengths, 288, INFLATE_LIT_BITS);
+
+    for(i=0; i<30; i++) lengths[i] = 5;
+
+    buildHuffman(&state->dist, lengths, 30, INFLATE_DIST_BITS);
+
+    return inflateCodes(s, &state->lit, &state->dist);
+}
+
+// like zlib, an incomplete code is only accepted when it has no codes or a
+// single one bit code
+static int checkCode(const InflateHuffman *h, int left, int n)
+{
+    int used = n - h->count[0];
+
+    return left == 0 || (left > 0 && (used == 0 || (used == 1 && h->count[1] == 1)));
+}
+
+static int inflateDynamic(InflateStream *s, InflateState *state)
+{
+    u8 lengths[288 + 30];
+    int nlen, ndist, ncode, index, i;
+
+    refill(s);
+    nlen = getBits(s, 5) + 257;
+    ndist = getBits(s, 5) + 1;
+    ncode = getBits(s, 4) + 4;
+
+    if(nlen > 286 || ndist > 30)
+    {
+        return INFLATE_ERROR_DATA;
+    }
+
+    for(i=0; i<19; i++)
+    {
+        if(i < ncode)
+        {
+            refill(s);
+            lengths[g_codeLengthOrder[i]] = getBits(s, 3);
+        }
+        else
+        {
+            lengths[g_codeLengthOrder[i]] = 0;
+        }
+    }
+
+    // the code length code has to be complete
+    if(buildHuffman(&state->lit, lengths, 19, 7) != 0)
+    {
+        return INFLATE_ERROR_DATA;
+    }
+
+    for(index=0; index<nlen+ndist;)
+    {
+        int sym, len = 0, repeat;
+
+        refill(s);
+        sym = decode(s, &state->lit);
+
+        if(sym < 0)
+        {
+            return sym;
+        }
+
+        if(sym < 16)
+        {
+            lengths[index++] = sym;
+            continue;
+        }
+
+        if(sym == 16)
+        {
+            if(index == 0)
+            {
+                return INFLATE_ERROR_DATA;
+            }
+
+            len = lengths[index-1];
+            repeat = 3 + getBits(s, 2);
+        }
+        else if(sym == 17)
+        {
+            repeat = 3 + getBits(s, 3);
+        }
+        else
+        {
+            repeat = 11 + getBits(s, 7);
+        }
+
+        if(index + repeat > nlen + ndist)
+        {
+            return INFLATE_ERROR_DATA;
+        }
+
+        while(repeat-- > 0)
+        {
+            lengths[index++] = len;
+        }
+    }
+
+    // without an end of block code the block never ends
+    if(lengths[256] == 0)
+    {
+        return INFLATE_ERROR_DATA;
+    }
+
+    if(!checkCode(&state->lit, buildHuffman(&state->lit, lengths, nlen, INFLATE_LIT_BITS), nlen) ||
+        !checkCode(&state->dist, buildHuffman(&state->dist, lengths + nlen, ndist, INFLATE_DIST_BITS), ndist))
+    {
+        return INFLATE_ERROR_DATA;
+    }
+
+    return inflateCodes(s, &state->lit, &state->dist);
+}
+
+int inflateBlock(u8 *dest, u32 destSize, const u8 *src, InflateState *state)
+{
+    InflateStream s;
+    int last, ret;
+
+    s.in = src;
+    s.bitbuf = 0;
+    s.bitcnt = 0;
+    s.out = s.out_start = dest;
+    s.out_end = dest + destSize;
+
+    do
+    {
+        refill(&s);
+        last = getBits(&s, 1);
+
+        switch(getBits(&s, 2))
+        {
+            case 0: ret = inflateStored(&s); break;
+            case 1: ret = inflateFixed(&s, state); break;
+            case 2: ret = inflateDynamic(&s, state); break;
+            default: ret = INFLATE_ERROR_DATA; break;
+        }
+
+        if(ret < 0)
+        {
+            return ret;
+        }
+    } while(!last);
+
+    return s.out - s.out_start;
+}
+
+void inflateModuleInit(void)
+{
+    if(g_inflateLock < 0)
+    {
+        g_inflateLock = sceKernelCreateSema("PopcornInflate", 0, 1, 1, NULL);
+    }
+}
+
+int inflateDecompress(u8 *dest, u32 destSize, const void *src)
+{
+    int ret;
+
+    sceKernelWaitSema(g_inflateLock, 1, NULL);
+    ret = inflateBlock(dest, destSize, src, &g_inflateState);
+    sceKernelSignalSema(g_inflateLock, 1);
+
+    return ret;
+}
@@ -0,0 +1,53 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <psptypes.h>
+
+#define INFLATE_LIT_BITS 10
+#define INFLATE_DIST_BITS 8
+
+// Codes up to the table bits decode with one lookup, entries hold the symbol
+// above the code length, 0 = longer code. count and symbol are the canonical
+// code the longer ones are decoded from.
+typedef struct
+{
+    u16 table[1 << INFLATE_LIT_BITS];
+    u16 count[16];
+    u16 symbol[288];
+    int bits;
+} InflateHuffman;
+
+typedef struct
+{
+    InflateHuffman lit;
+    InflateHuffman dist;
+} InflateState;
+
+// Inflates a raw deflate stream like sceKernelDeflateDecompress and returns
+// the inflated size or a negative value on a bad stream or when it does not
+// fit in destSize. The length of src is not known, so up to 4 bytes past the
+// end of the stream may be read. state is scratch space, nothing is allocated.
+int inflateBlock(u8 *dest, u32 destSize, const u8 *src, InflateState *state);
+
+// inflateBlock on the module's own scratch space, safe to call from any thread
+void inflateModuleInit(void);
+int inflateDecompress(u8 *dest, u32 destSize, const void *src);
+
+#endif
@@ -0,0 +1,477 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+
+#include <string.h>
+#include <pspkernel.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "config.h"
+#include "keystore.h"
+
+// seplugins/popcorn.keys holds the version keys of all titles, built by
+// tools/mkkeystore.py from existing KEYS.BIN files and grown by the module:
+// a header, the content ID of the first record of every page, then pages of
+// records sorted by content ID. New keys are appended behind the sorted
+// records and merged into them once KEY_STORE_MAX_APPENDED have piled up,
+// the merged store is written to popcorn.keys.tmp and renamed over the old one.
+#define KEY_STORE_NAME "popcorn.keys"
+#define KEY_STORE_TMP_NAME KEY_STORE_NAME ".tmp"
+#define KEY_STORE_MAGIC 0x534B4350 // PCKS
+#define KEY_STORE_VERSION 1
+#define KEY_STORE_PAGE_RECORDS 32
+#define KEY_STORE_MAX_PAGES 16
+#define KEY_STORE_MAX_APPENDED 16
+#define KEY_STORE_MAX_RECORDS (KEY_STORE_MAX_PAGES * KEY_STORE_PAGE_RECORDS)
+#define KEY_STORE_ID_LENGTH 36
+
+typedef struct
+{
+    u32 magic;
+    u16 version;
+    u16 record_size;
+    u32 record_count; // sorted records
+    u16 page_records;
+    u16 page_count;
+    u32 data_offset;
+    u32 appended; // unsorted records behind the sorted ones, newest last
+    u32 reserved[2];
+} KeyStoreHeader;
+
+typedef struct
+{
+    char content_id[KEY_STORE_ID_SIZE];
+    u8 key[KEY_STORE_KEY_SIZE];
+} KeyStoreRecord;
+
+#define KEY_STORE_FRONT_SIZE (sizeof(KeyStoreHeader) + KEY_STORE_MAX_PAGES * KEY_STORE_ID_SIZE)
+#define KEY_STORE_BUF_SIZE (KEY_STORE_PAGE_RECORDS * sizeof(KeyStoreRecord))
+
+static u8 g_keyStoreBuf[KEY_STORE_BUF_SIZE + 64];
+
+int keyStoreEnabled(void)
+{
+    return getConfigInt("key_store", 0) != 0;
+}
+
+int keyStoreContentId(char *id, const void *src)
+{
+    const char *s = src;
+    int i;
+
+    for(i=0; i<KEY_STORE_ID_LENGTH; i++)
+    {
+        char c = s[i];
+
+        if(i == 6 || i == 19)
+        {
+            if(c != '-')
+            {
+                return -1;
+            }
+        }
+        else if(i == 16)
+        {
+            if(c != '_')
+            {
+                return -1;
+            }
+        }
+        else if((c < '0' || c > '9') && (c < 'A' || c > 'Z'))
+        {
+            return -1;
+        }
+    }
+
+    memset(id, 0, KEY_STORE_ID_SIZE);
+    memcpy(id, s, KEY_STORE_ID_LENGTH);
+
+    return 0;
+}
+
+static int isValidHeader(const KeyStoreHeader *header)
+{
+    return header->magic == KEY_STORE_MAGIC &&
+        header->version == KEY_STORE_VERSION &&
+        header->record_size == sizeof(KeyStoreRecord) &&
+        header->page_records != 0 &&
+        header->page_records <= KEY_STORE_PAGE_RECORDS &&
+        header->page_count <= KEY_STORE_MAX_PAGES &&
+        header->page_count == (header->record_count + header->page_records - 1) / header->page_records &&
+        header->data_offset == sizeof(KeyStoreHeader) + header->page_count * KEY_STORE_ID_SIZE &&
+        header->appended <= KEY_STORE_MAX_APPENDED;
+}
+
+// binary search over sorted records, returns the index of id or where it goes as -index-1
+static int findRecord(const KeyStoreRecord *records, int count, const char *id)
+{
+    int lower = 0, upper = count - 1;
+
+    while(lower <= upper)
+    {
+        int half = (lower + upper) / 2;
+        int cmp = memcmp(records[half].content_id, id, KEY_STORE_ID_SIZE);
+
+        if(cmp == 0)
+        {
+            return half;
+        }
+
+        if(cmp < 0)
+        {
+            lower = half + 1;
+        }
+        else
+        {
+            upper = half - 1;
+        }
+    }
+
+    return -lower - 1;
+}
+
+// Returns the size bytes at offset of the store, straight from the front
+// read while they are in it, otherwise read into buf.
+static u8 *loadRange(SceUID fd, u8 *buf, int *front, u32 offset, u32 size)
+{
+    if(offset + size <= (u32)*front)
+    {
+        return buf + offset;
+    }
+
+    // anything read after this replaces the front
+    *front = 0;
+    sceIoLseek32(fd, offset, PSP_SEEK_SET);
+
+    return sceIoRead(fd, buf, size) == (int)size ? buf : NULL;
+}
+
+int keyStoreLookup(const char *id, unsigned char *key)
+{
+    char path[64];
+    KeyStoreHeader header;
+    const KeyStoreRecord *records;
+    const char *index;
+    u8 *buf;
+    SceUID fd;
+    int front, lower, upper, page, count, i, ret = -1;
+
+    buf = (u8*)((((u32)g_keyStoreBuf) & ~(64-1)) + 64);
+
+    if(getPluginDataPath(KEY_STORE_NAME, path, sizeof(path)) < 0)
+    {
+        return -1;
+    }
+
+    fd = sceIoOpen(path, PSP_O_RDONLY, 0777);
+
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    // small stores are read in full by this, large ones up to the index
+    front = sceIoRead(fd, buf, KEY_STORE_BUF_SIZE);
+
+    if(front < (int)sizeof(header))
+    {
+        goto exit;
+    }
+
+    memcpy(&header, buf, sizeof(header));
+    index = (const char*)(buf + sizeof(header));
+
+    if(!isValidHeader(&header) || (u32)front < header.data_offset)
+    {
+        #if DEBUG >= 3
+        printk("%s: unusable %s\r\n", __func__, path);
+        #endif
+        goto exit;
+    }
+
+    // last page whose first content ID is <= the one we want
+    lower = 0;
+    upper = header.page_count - 1;
+    page = -1;
+
+    while(lower <= upper)
+    {
+        int half = (lower + upper) / 2;
+
+        if(memcmp(index + half * KEY_STORE_ID_SIZE, id, KEY_STORE_ID_SIZE) <= 0)
+        {
+            page = half;
+            lower = half + 1;
+        }
+        else
+        {
+            upper = half - 1;
+        }
+    }
+
+    // appended records replace sorted ones, the newest first
+    if(header.appended > 0)
+    {
+        records = (const KeyStoreRecord*)loadRange(fd, buf, &front,
+            header.data_offset + header.record_count * sizeof(KeyStoreRecord), header.appended * sizeof(KeyStoreRecord));
+
+        for(i=header.appended-1; records != NULL && i>=0; i--)
+        {
+            if(memcmp(records[i].content_id, id, KEY_STORE_ID_SIZE) == 0)
+            {
+                memcpy(key, records[i].key, KEY_STORE_KEY_SIZE);
+                ret = 0;
+                goto exit;
+            }
+        }
+    }
+
+    if(page < 0)
+    {
+        goto exit;
+    }
+
+    count = header.record_count - page * header.page_records;
+
+    if(count > header.page_records)
+    {
+        count = header.page_records;
+    }
+
+    records = (const KeyStoreRecord*)loadRange(fd, buf, &front,
+        header.data_offset + page * header.page_records * sizeof(KeyStoreRecord), count * sizeof(KeyStoreRecord));
+
+    if(records != NULL && (i = findRecord(records, count, id)) >= 0)
+    {
+        memcpy(key, records[i].key, KEY_STORE_KEY_SIZE);
+        ret = 0;
+    }
+
+exit:
+    sceIoClose(fd);
+
+    #if DEBUG >= 3
+    printk("%s: %s -> %d\r\n", __func__, id, ret);
+    #endif
+
+    return ret;
+}
+
+// Merges the appended records and the new one into the sorted ones and
+// writes the result to a new file that replaces the store, so the old one is
+// intact until the new one is complete. The front is built right in front of
+// the records so the whole file goes out with a single write. Nothing is
+// written when the merged records don't fit.
+static int compactStore(SceUID fd, const char *path, const KeyStoreHeader *old, const KeyStoreRecord *record)
+{
+    char tmp[64];
+    KeyStoreHeader *header;
+    KeyStoreRecord *records;
+    u32 total, count, size, pages, i;
+    SceUID block;
+    u8 *base, *front;
+    int ret = -1;
+
+    if(getPluginDataPath(KEY_STORE_TMP_NAME, tmp, sizeof(tmp)) < 0)
+    {
+        sceIoClose(fd);
+        return -1;
+    }
+
+    total = old->record_count + old->appended;
+    size = KEY_STORE_FRONT_SIZE + (total + 1) * sizeof(KeyStoreRecord);
+    block = sceKernelAllocPartitionMemory(PSP_MEMORY_PARTITION_KERNEL, "PopcornKeyStore", PSP_SMEM_Low, size, NULL);
+
+    if(block < 0)
+    {
+        sceIoClose(fd);
+        return -1;
+    }
+
+    base = sceKernelGetBlockHeadAddr(block);
+    records = (KeyStoreRecord*)(base + KEY_STORE_FRONT_SIZE);
+    sceIoLseek32(fd, old->data_offset, PSP_SEEK_SET);
+
+    if(sceIoRead(fd, records, total * sizeof(KeyStoreRecord)) != (int)(total * sizeof(KeyStoreRecord)))
+    {
+        goto exit;
+    }
+
+    // the new record is the last one appended
+    memcpy(&records[total], record, sizeof(*record));
+    count = old->record_count;
+
+    for(i=old->record_count; i<=total; i++)
+    {
+        KeyStoreRecord appended;
+        int pos;
+
+        memcpy(&appended, &records[i], sizeof(appended));
+        pos = findRecord(records, count, appended.content_id);
+
+        if(pos >= 0)
+        {
+            memcpy(records[pos].key, appended.key, KEY_STORE_KEY_SIZE);
+            continue;
+        }
+
+        pos = -pos - 1;
+        memmove(&records[pos+1], &records[pos], (count - pos) * sizeof(KeyStoreRecord));
+        memcpy(&records[pos], &appended, sizeof(appended));
+        count++;
+    }
+
+    if(count > KEY_STORE_MAX_RECORDS)
+    {
+        #if DEBUG >= 3
+        printk("%s: %u records don't fit\r\n", __func__, (uint)count);
+        #endif
+        goto exit;
+    }
+
+    pages = (count + KEY_STORE_PAGE_RECORDS - 1) / KEY_STORE_PAGE_RECORDS;
+    front = (u8*)records - sizeof(KeyStoreHeader) - pages * KEY_STORE_ID_SIZE;
+    header = (KeyStoreHeader*)front;
+    memset(header, 0, sizeof(*header));
+    header->magic = KEY_STORE_MAGIC;
+    header->version = KEY_STORE_VERSION;
+    header->record_size = sizeof(KeyStoreRecord);
+    header->record_count = count;
+    header->page_records = KEY_STORE_PAGE_RECORDS;
+    header->page_count = pages;
+    header->data_offset = sizeof(KeyStoreHeader) + pages * KEY_STORE_ID_SIZE;
+
+    for(i=0; i<pages; i++)
+    {
+        memcpy(front + sizeof(KeyStoreHeader) + i * KEY_STORE_ID_SIZE, records[i * KEY_STORE_PAGE_RECORDS].content_id, KEY_STORE_ID_SIZE);
+    }
+
+    sceIoClose(fd);
+    fd = sceIoOpen(tmp, PSP_O_WRONLY | PSP_O_CREAT | PSP_O_TRUNC, 0777);
+
+    if(fd < 0)
+    {
+        goto exit;
+    }
+
+    size = header->data_offset + count * sizeof(KeyStoreRecord);
+    ret = sceIoWrite(fd, front, size) == (int)size ? 0 : -1;
+    sceIoClose(fd);
+    fd = -1;
+
+    if(ret < 0)
+    {
+        sceIoRemove(tmp);
+        goto exit;
+    }
+
+    // FAT won't rename over an existing file, the old store only goes once the new one is written
+    if(sceIoRename(tmp, path) < 0)
+    {
+        sceIoRemove(path);
+        ret = sceIoRename(tmp, path) < 0 ? -1 : 0;
+    }
+
+exit:
+    if(fd >= 0)
+    {
+        sceIoClose(fd);
+    }
+
+    sceKernelFreePartitionMemory(block);
+
+    return ret;
+}
+
+int keyStoreInsert(const char *id, const unsigned char *key)
+{
+    char path[64];
+    KeyStoreHeader header;
+    KeyStoreRecord record;
+    SceIoStat stat;
+    SceUID fd;
+    int ret;
+
+    if(getPluginDataPath(KEY_STORE_NAME, path, sizeof(path)) < 0)
+    {
+        return -1;
+    }
+
+    // a compaction cut off between removing the old store and renaming the new one
+    if(sceIoGetstat(path, &stat) < 0)
+    {
+        char tmp[64];
+
+        if(getPluginDataPath(KEY_STORE_TMP_NAME, tmp, sizeof(tmp)) == 0)
+        {
+            sceIoRename(tmp, path);
+        }
+    }
+
+    fd = sceIoOpen(path, PSP_O_RDWR | PSP_O_CREAT, 0777);
+
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    memcpy(record.content_id, id, KEY_STORE_ID_SIZE);
+    memcpy(record.key, key, KEY_STORE_KEY_SIZE);
+    ret = sceIoRead(fd, &header, sizeof(header));
+
+    if(ret == 0)
+    {
+        // new store, records are appended right behind the header
+        memset(&header, 0, sizeof(header));
+        header.magic = KEY_STORE_MAGIC;
+        header.version = KEY_STORE_VERSION;
+        header.record_size = sizeof(KeyStoreRecord);
+        header.page_records = KEY_STORE_PAGE_RECORDS;
+        header.data_offset = sizeof(header);
+    }
+    else if(ret != sizeof(header) || !isValidHeader(&header) ||
+        sceIoLseek32(fd, 0, PSP_SEEK_END) < (int)(header.data_offset + (header.record_count + header.appended) * sizeof(KeyStoreRecord)))
+    {
+        // not ours to overwrite, or cut short and appending would leave a hole
+        sceIoClose(fd);
+        return -1;
+    }
+
+    // a full store only takes keys of titles it has, merging finds out whether this is one
+    if(header.appended == KEY_STORE_MAX_APPENDED || header.record_count + header.appended >= KEY_STORE_MAX_RECORDS)
+    {
+        // closes fd
+        return compactStore(fd, path, &header, &record);
+    }
+
+    sceIoLseek32(fd, header.data_offset + (header.record_count + header.appended) * sizeof(KeyStoreRecord), PSP_SEEK_SET);
+    ret = -1;
+
+    // the header is only updated once the record is there
+    if(sceIoWrite(fd, &record, sizeof(record)) == sizeof(record))
+    {
+        header.appended++;
+        sceIoLseek32(fd, 0, PSP_SEEK_SET);
+        ret = sceIoWrite(fd, &header, sizeof(header)) == sizeof(header) ? 0 : -1;
+    }
+
+    sceIoClose(fd);
+
+    return ret;
+}
@@ -0,0 +1,40 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+
+#ifndef KEYSTORE_H
+#define KEYSTORE_H
+
+#include <psptypes.h>
+
+// "UP9000-SCUS94163_00-0000000000000001" and zero padding, as at RIF+0x10
+#define KEY_STORE_ID_SIZE 0x30
+#define KEY_STORE_KEY_SIZE 16
+
+// key_store = 1 in seplugins/popcorn.ini
+int keyStoreEnabled(void);
+
+// copies a content ID of a RIF or DATA.PSP to id, returns -1 when it isn't one
+int keyStoreContentId(char *id, const void *src);
+
+// returns 0 and fills key when seplugins/popcorn.keys has the title
+int keyStoreLookup(const char *id, unsigned char *key);
+
+// appends the key, newer records win over older ones of the same title
+int keyStoreInsert(const char *id, const unsigned char *key);
+
+#endif
@@ -0,0 +1,191 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#include <string.h>
+#include <pspkernel.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "lz4.h"
+
+#define LZ4_ERROR_DATA -1
+#define LZ4_ERROR_OUTPUT -2
+#define LZ4_MIN_MATCH 4
+
+int lz4GetBlockSize(const u8 *src)
+{
+    Lz4BlockHeader header;
+
+    // src comes straight from a read buffer and may not be aligned
+    memcpy(&header, src, sizeof(header));
+
+    if(header.magic != LZ4_BLOCK_MAGIC || header.size > 0x7FFFFFFF)
+    {
+        return -1;
+    }
+
+    return header.size;
+}
+
+// the 4 bit length of a token continues in bytes while they are 255
+static inline int readLength(const u8 **ip, const u8 *iend, u32 *len)
+{
+    u32 b;
+
+    if(*len != 15)
+    {
+        return 0;
+    }
+
+    do
+    {
+        if(*ip >= iend)
+        {
+            return LZ4_ERROR_DATA;
+        }
+
+        b = *(*ip)++;
+        *len += b;
+    } while(b == 255);
+
+    return 0;
+}
+
+static inline void copyMatch(u8 *out, u32 dist, u32 len)
+{
+    const u8 *from = out - dist;
+
+    if(dist == 1)
+    {
+        memset(out, *from, len);
+        return;
+    }
+
+    if(dist >= 4)
+    {
+        while(len >= 4)
+        {
+            u32 word;
+
+            memcpy(&word, from, 4);
+            memcpy(out, &word, 4);
+            from += 4;
+            out += 4;
+            len -= 4;
+        }
+    }
+
+    while(len-- > 0)
+    {
+        *out++ = *from++;
+    }
+}
+
+int lz4DecompressBlock(u8 *dest, u32 destSize, const u8 *src, u32 srcSize)
+{
+    const u8 *ip = src;
+    const u8 *iend = src + srcSize;
+    u8 *op = dest;
+    u8 *oend = dest + destSize;
+
+    while(1)
+    {
+        u32 token, len, dist;
+
+        if(ip >= iend)
+        {
+            return LZ4_ERROR_DATA;
+        }
+
+        token = *ip++;
+        len = token >> 4;
+
+        // Short literal runs are copied as a fixed 16 bytes when both buffers
+        // have room, the bytes past the run get overwritten by what follows.
+        // Such a run is never the last sequence, which ends the input.
+        if(len < 15 && iend - ip >= 16 + 2 && oend - op >= 16)
+        {
+            memcpy(op, ip, 16);
+            op += len;
+            ip += len;
+        }
+        else
+        {
+            if(readLength(&ip, iend, &len) < 0 || len > iend - ip)
+            {
+                return LZ4_ERROR_DATA;
+            }
+
+            if(len > oend - op)
+            {
+                return LZ4_ERROR_OUTPUT;
+            }
+
+            memcpy(op, ip, len);
+            op += len;
+            ip += len;
+
+            // the last sequence is literals only
+            if(ip == iend)
+            {
+                break;
+            }
+
+            if(iend - ip < 2)
+            {
+                return LZ4_ERROR_DATA;
+            }
+        }
+
+        dist = ip[0] | (ip[1] << 8);
+        ip += 2;
+        len = token & 15;
+
+        if(dist == 0 || dist > op - dest)
+        {
+            return LZ4_ERROR_DATA;
+        }
+
+        // matches of up to 18 bytes far enough back take three word copies
+        if(len < 15 && dist >= 8 && oend - op >= 24)
+        {
+            memcpy(op, op - dist, 8);
+            memcpy(op + 8, op + 8 - dist, 8);
+            memcpy(op + 16, op + 16 - dist, 8);
+            op += len + LZ4_MIN_MATCH;
+            continue;
+        }
+
+        if(readLength(&ip, iend, &len) < 0)
+        {
+            return LZ4_ERROR_DATA;
+        }
+
+        len += LZ4_MIN_MATCH;
+
+        if(len > oend - op)
+        {
+            return LZ4_ERROR_OUTPUT;
+        }
+
+        copyMatch(op, dist, len);
+        op += len;
+    }
+
+    return op - dest;
+}
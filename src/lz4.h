@@ -0,0 +1,42 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <psptypes.h>
+
+// Blocks repacked by popcorn_repack start with this header instead of a
+// deflate stream. The first byte has deflate block type 3, which is invalid,
+// so a real deflate block is never mistaken for one.
+#define LZ4_BLOCK_MAGIC 0x345A4CFF // "\xFFLZ4"
+#define LZ4_BLOCK_HEADER_SIZE 8
+
+typedef struct
+{
+    u32 magic;
+    u32 size; // of the LZ4 block that follows, little endian
+} Lz4BlockHeader;
+
+// size of the LZ4 data after the header of a marked block, -1 for deflate
+int lz4GetBlockSize(const u8 *src);
+
+// Decodes an LZ4 block (no frame) of srcSize bytes, returns the decoded size
+// or a negative value on a bad block or when it does not fit in destSize.
+int lz4DecompressBlock(u8 *dest, u32 destSize, const u8 *src, u32 srcSize);
+
+#endif
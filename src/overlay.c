@@ -0,0 +1,159 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+
+#include <string.h>
+#include <pspkernel.h>
+
+#include "overlay.h"
+
+// Overlays of one file sorted by start. max_end[i] is the highest end of
+// entries 0..i, which never decreases, so the first overlay that can reach
+// a read and the first one starting behind it are both a binary search away.
+typedef struct
+{
+    int count;
+    Overlay entries[OVERLAY_MAX];
+    u32 max_end[OVERLAY_MAX];
+} OverlayTable;
+
+static OverlayTable g_overlays[OVERLAY_FILES];
+
+void overlayClear(void)
+{
+    memset(g_overlays, 0, sizeof(g_overlays));
+}
+
+int overlayAdd(int file, u32 offset, u32 size, u32 flags, const void *data, OverlayFill fill)
+{
+    OverlayTable *table;
+    Overlay *overlay;
+    int i;
+
+    if(file < 0 || file >= OVERLAY_FILES || size == 0)
+    {
+        return -1;
+    }
+
+    table = &g_overlays[file];
+
+    if(table->count >= OVERLAY_MAX)
+    {
+        return -1;
+    }
+
+    // behind every overlay starting at or before it, so later ones win ties
+    for(i=table->count; i>0 && table->entries[i-1].start > offset; i--)
+    {
+        table->entries[i] = table->entries[i-1];
+    }
+
+    overlay = &table->entries[i];
+    overlay->start = offset;
+    overlay->end = offset + size;
+    overlay->flags = flags;
+    overlay->data = data;
+    overlay->fill = fill;
+    table->count++;
+
+    for(; i<table->count; i++)
+    {
+        u32 end = table->entries[i].end;
+
+        table->max_end[i] = (i > 0 && table->max_end[i-1] > end) ? table->max_end[i-1] : end;
+    }
+
+    return 0;
+}
+
+void overlayApply(int file, u8 *buf, u32 pos, u32 len, u32 size)
+{
+    const OverlayTable *table = &g_overlays[file];
+    u32 end = pos + len;
+    int lower, upper, first, last;
+
+    if(table->count == 0 || len == 0)
+    {
+        return;
+    }
+
+    // first overlay whose entries up to it reach past pos
+    lower = 0;
+    upper = table->count;
+
+    while(lower < upper)
+    {
+        int half = (lower + upper) / 2;
+
+        if(table->max_end[half] > pos)
+        {
+            upper = half;
+        }
+        else
+        {
+            lower = half + 1;
+        }
+    }
+
+    first = lower;
+
+    // first overlay starting at or after the end of the read
+    upper = table->count;
+
+    while(lower < upper)
+    {
+        int half = (lower + upper) / 2;
+
+        if(table->entries[half].start < end)
+        {
+            lower = half + 1;
+        }
+        else
+        {
+            upper = half;
+        }
+    }
+
+    last = lower;
+
+    for(int i=first; i<last; i++)
+    {
+        const Overlay *overlay = &table->entries[i];
+        u32 start = overlay->start > pos ? overlay->start : pos;
+        u32 stop = overlay->end < end ? overlay->end : end;
+
+        if(start >= stop)
+        {
+            continue;
+        }
+
+        if((overlay->flags & OVERLAY_EXACT) &&
+            (pos != overlay->start || len != overlay->end - overlay->start || size != len))
+        {
+            continue;
+        }
+
+        if(overlay->fill != NULL)
+        {
+            overlay->fill(overlay, buf + (start - pos), start - overlay->start, stop - start);
+        }
+        else
+        {
+            memcpy(buf + (start - pos), (const u8*)overlay->data + (start - overlay->start), stop - start);
+        }
+    }
+}
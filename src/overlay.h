@@ -0,0 +1,62 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <psptypes.h>
+
+// files overlays are kept for
+enum
+{
+    OVERLAY_EBOOT = 0,
+    OVERLAY_FILES,
+};
+
+// per file, config and libcrypt word of up to 5 discs plus the icon
+#define OVERLAY_MAX 16
+
+// only replaces a read of exactly the overlay's range, not every read overlapping it
+#define OVERLAY_EXACT 1
+
+typedef struct Overlay Overlay;
+
+// Computes size bytes of the overlay, starting offset bytes into it, in place:
+// dest holds what was read from the file there.
+typedef void (*OverlayFill)(const Overlay *overlay, u8 *dest, u32 offset, u32 size);
+
+struct Overlay
+{
+    u32 start; // file offset
+    u32 end; // file offset of the first byte after it
+    u32 flags;
+    const void *data; // copied when fill is NULL, otherwise passed to fill
+    OverlayFill fill;
+};
+
+// drops every overlay, the table is only changed before the hooks run
+void overlayClear(void);
+
+// returns -1 when the table of file is full
+int overlayAdd(int file, u32 offset, u32 size, u32 flags, const void *data, OverlayFill fill);
+
+// Applies the overlays of file to len bytes read at pos into buf, for a read
+// of size bytes. Where overlays overlap, the one starting later wins.
+void overlayApply(int file, u8 *buf, u32 pos, u32 len, u32 size);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+
+#include <string.h>
+#include <pspkernel.h>
+#include <psputilsforkernel.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "patch.h"
+
+// touched lines, sorted and without duplicates
+static u32 g_patchLines[PATCH_MAX_LINES];
+static int g_patchLineCount;
+static int g_patchOverflow;
+
+static void patchNoteRange(u32 addr, u32 size)
+{
+    u32 line, last = (addr + size - 1) & ~(PATCH_LINE_SIZE - 1);
+
+    for(line = addr & ~(PATCH_LINE_SIZE - 1); line <= last; line += PATCH_LINE_SIZE)
+    {
+        int i = g_patchLineCount;
+
+        while(i > 0 && g_patchLines[i-1] > line)
+        {
+            i--;
+        }
+
+        if(i > 0 && g_patchLines[i-1] == line)
+        {
+            continue;
+        }
+
+        if(g_patchLineCount >= PATCH_MAX_LINES)
+        {
+            g_patchOverflow = 1;
+            continue;
+        }
+
+        memmove(&g_patchLines[i+1], &g_patchLines[i], (g_patchLineCount - i) * sizeof(g_patchLines[0]));
+        g_patchLines[i] = line;
+        g_patchLineCount++;
+    }
+}
+
+void patchWord(u32 addr, u32 value)
+{
+    _sw(value, addr);
+    patchNoteRange(addr, sizeof(value));
+}
+
+void patchHalf(u32 addr, u16 value)
+{
+    _sh(value, addr);
+    patchNoteRange(addr, sizeof(value));
+}
+
+int patchHookImport(SceModule *mod, const char *library, u32 nid, void *func)
+{
+    u32 stub = sctrlFindImportByNID(mod, library, nid);
+
+    // a stub is a jump and its delay slot, or a syscall
+    if(stub != 0)
+    {
+        patchNoteRange(stub, 8);
+    }
+
+    return sctrlHookImportByNID(mod, library, nid, func);
+}
+
+void patchFlush(void)
+{
+    int i = 0;
+
+    if(g_patchOverflow)
+    {
+        sctrlFlushCache();
+    }
+    else
+    {
+        while(i < g_patchLineCount)
+        {
+            u32 start = g_patchLines[i];
+            u32 end = start + PATCH_LINE_SIZE;
+
+            // neighbouring lines go out as one range
+            for(i++; i < g_patchLineCount && g_patchLines[i] == end; i++)
+            {
+                end += PATCH_LINE_SIZE;
+            }
+
+            sceKernelDcacheWritebackRange((void*)start, end - start);
+            sceKernelIcacheInvalidateRange((void*)start, end - start);
+        }
+    }
+
+    #if DEBUG >= 3
+    printk("%s: %d lines%s\r\n", __func__, g_patchLineCount, g_patchOverflow ? ", full flush" : "");
+    #endif
+
+    g_patchLineCount = 0;
+    g_patchOverflow = 0;
+}
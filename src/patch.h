@@ -0,0 +1,40 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <pspkernel.h>
+
+// PSP cache lines, dcache and icache alike
+#define PATCH_LINE_SIZE 64
+// more lines than this fall back to a full flush
+#define PATCH_MAX_LINES 32
+
+// write module code and remember the cache lines touched
+void patchWord(u32 addr, u32 value);
+void patchHalf(u32 addr, u16 value);
+
+// sctrlHookImportByNID, with the import stub remembered
+int patchHookImport(SceModule *mod, const char *library, u32 nid, void *func);
+
+// Writes back the dcache and invalidates the icache of the lines touched
+// since the last call, in as few ranges as possible.
+void patchFlush(void);
+
+#endif
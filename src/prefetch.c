@@ -0,0 +1,422 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#include <string.h>
+#include <pspkernel.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "config.h"
+#include "prefetch.h"
+#include "stats.h"
+
+// Once the EBOOT is read sequentially a few times in a row, a low priority
+// thread reads ahead of the game into a ring buffer through its own fd. The
+// ring holds [g_bufStart, g_bufStart+g_bufValid) of the file, every file
+// position at the same place modulo the window, so consuming it only moves
+// g_bufStart and nothing is ever copied around. Reads landing in it cost a
+// memcpy instead of a Memory Stick access. The lock only covers the indices:
+// the thread fills the ring past g_bufValid without it, and hits copy out of
+// it without it while they keep the thread from starting another read.
+//
+// The thread only stays g_ahead bytes ahead of the game. That starts at
+// PREFETCH_AHEAD_MIN for every sequential run and only doubles, up to the
+// window, when a read doesn't fit in it, so a short run doesn't read
+// megabytes nobody asks for. A read the thread is already bringing in waits
+// for it rather than reading the same bytes from the Memory Stick again.
+#define PREFETCH_CHUNK 0x8000
+#define PREFETCH_AHEAD_MIN (2 * PREFETCH_CHUNK)
+#define PREFETCH_MAX_KB 4096
+#define PREFETCH_SEQUENTIAL 2 // reads in a row before read ahead starts
+#define PREFETCH_THREAD_PRIORITY 0x70
+#define PREFETCH_WAIT_US 20000 // a starved thread makes the read go to the file
+
+static u8 *g_prefetchBuf;
+static SceUID g_prefetchLock = -1;
+static SceUID g_prefetchWake = -1;
+static SceUID g_prefetchFilled = -1;
+static PopcornPrefetchStats g_prefetchStats;
+
+// under g_prefetchLock
+static SceUID g_streamFd = -1;
+static char g_streamPath[128];
+static u32 g_streamGen; // bumped on every restart, older reads are dropped
+static u32 g_pathGen;
+static u32 g_bufStart;
+static u32 g_bufValid;
+static u32 g_ahead;
+static int g_streamEof;
+static int g_readers; // hits copying out of the ring
+static int g_filling; // the thread is reading at g_bufStart+g_bufValid
+static int g_waiters; // reads waiting for it
+static u32 g_wantEnd; // where the furthest of them ends
+
+// sequential access detection, only touched by the read hooks
+static u32 g_lastEnd;
+static int g_sequential;
+
+// under g_prefetchLock: whether a chunk, or all that is left of a smaller budget, is free
+static int needsFill(void)
+{
+    u32 cap = g_ahead < g_prefetchStats.window ? g_ahead : g_prefetchStats.window;
+
+    if(g_streamFd < 0 || g_streamEof || g_bufValid >= cap)
+    {
+        return 0;
+    }
+
+    return cap - g_bufValid >= (cap < PREFETCH_CHUNK ? cap : PREFETCH_CHUNK);
+}
+
+// under g_prefetchLock: whether the thread brings the ring up to end without another restart
+static int willFill(u32 end)
+{
+    u32 cap = g_ahead < g_prefetchStats.window ? g_ahead : g_prefetchStats.window;
+
+    if(end - g_bufStart > cap)
+    {
+        return 0;
+    }
+
+    return g_filling || (g_readers == 0 && needsFill());
+}
+
+// under g_prefetchLock: start over at pos, whatever is buffered or being read is dropped
+static void restartAt(u32 pos, u32 ahead)
+{
+    g_bufStart = pos;
+    g_bufValid = 0;
+    g_ahead = ahead < g_prefetchStats.window ? ahead : g_prefetchStats.window;
+    g_streamEof = 0;
+    g_streamGen++;
+    g_prefetchStats.restarts++;
+}
+
+// under g_prefetchLock: the game is done with everything before end
+static void consumeTo(u32 end)
+{
+    if(end > g_bufStart && end <= g_bufStart + g_bufValid)
+    {
+        g_bufValid -= end - g_bufStart;
+        g_bufStart = end;
+    }
+}
+
+static int prefetchThread(SceSize args, void *argp)
+{
+    SceUID fd = -1;
+    u32 fdPathGen = 0, fdPos = 0;
+
+    while(1)
+    {
+        sceKernelWaitSema(g_prefetchWake, 1, NULL);
+
+        while(1)
+        {
+            u32 gen, pos, slot, len;
+            int n = -1;
+
+            sceKernelWaitSema(g_prefetchLock, 1, NULL);
+
+            if(fd >= 0 && (g_streamFd < 0 || fdPathGen != g_pathGen))
+            {
+                sceIoClose(fd);
+                fd = -1;
+            }
+
+            // a hit copying out of the ring wakes the thread again when it is done
+            if(!needsFill() || g_readers > 0)
+            {
+                sceKernelSignalSema(g_prefetchLock, 1);
+                break;
+            }
+
+            if(fd < 0)
+            {
+                fd = sceIoOpen(g_streamPath, PSP_O_RDONLY, 0777);
+                fdPathGen = g_pathGen;
+                fdPos = 0;
+            }
+
+            gen = g_streamGen;
+            pos = g_bufStart + g_bufValid;
+            slot = pos % g_prefetchStats.window;
+            len = (g_ahead < g_prefetchStats.window ? g_ahead : g_prefetchStats.window) - g_bufValid;
+            // a waiting read is brought in with one read however big it is
+            if(g_waiters == 0 || g_wantEnd - pos < PREFETCH_CHUNK)
+            {
+                len = len < PREFETCH_CHUNK ? len : PREFETCH_CHUNK;
+            }
+            else
+            {
+                len = len < g_wantEnd - pos ? len : g_wantEnd - pos;
+            }
+
+            len = len < g_prefetchStats.window - slot ? len : g_prefetchStats.window - slot;
+            g_filling = 1;
+            sceKernelSignalSema(g_prefetchLock, 1);
+
+            // the ring past g_bufValid is only touched by this thread, a run
+            // carries on where the last chunk ended without a seek
+            if(fd >= 0 && (fdPos == pos || sceIoLseek(fd, pos, PSP_SEEK_SET) == pos))
+            {
+                n = sceIoRead(fd, g_prefetchBuf + slot, len);
+            }
+
+            fdPos = n > 0 ? pos + n : ~0u;
+            sceKernelWaitSema(g_prefetchLock, 1, NULL);
+            g_filling = 0;
+
+            if(g_waiters > 0)
+            {
+                sceKernelSignalSema(g_prefetchFilled, 1);
+            }
+
+            if(gen == g_streamGen)
+            {
+                if(n > 0)
+                {
+                    g_bufValid += n;
+                    g_prefetchStats.prefetched += n;
+                }
+
+                if(n < (int)len)
+                {
+                    g_streamEof = 1;
+                }
+            }
+
+            sceKernelSignalSema(g_prefetchLock, 1);
+        }
+    }
+
+    return 0;
+}
+
+void prefetchInit(void)
+{
+    int kb = getConfigInt("prefetch_kb", 0);
+    int partition = getConfigInt("prefetch_partition", 1);
+    SceUID block, thid;
+
+    if(g_prefetchBuf != NULL || kb <= 0)
+    {
+        return;
+    }
+
+    kb = kb < PREFETCH_MAX_KB ? kb : PREFETCH_MAX_KB;
+    block = sceKernelAllocPartitionMemory(partition, "PopcornPrefetch", PSP_SMEM_Low, kb << 10, NULL);
+
+    if(block < 0)
+    {
+        #if DEBUG >= 3
+        printk("%s: cannot allocate %dKB in partition %d -> 0x%08X\r\n", __func__, kb, partition, block);
+        #endif
+        return;
+    }
+
+    g_prefetchLock = sceKernelCreateSema("PopcornPrefetch", 0, 1, 1, NULL);
+    g_prefetchWake = sceKernelCreateSema("PopcornPrefetchWake", 0, 0, 1, NULL);
+    g_prefetchFilled = sceKernelCreateSema("PopcornPrefetchFilled", 0, 0, 1, NULL);
+    thid = sceKernelCreateThread("PopcornPrefetch", prefetchThread, PREFETCH_THREAD_PRIORITY, 0x1000, 0, NULL);
+
+    if(thid < 0)
+    {
+        sceKernelFreePartitionMemory(block);
+        return;
+    }
+
+    g_prefetchBuf = sceKernelGetBlockHeadAddr(block);
+    g_prefetchStats.window = kb << 10;
+    sceKernelStartThread(thid, 0, NULL);
+
+    #if DEBUG >= 3
+    printk("%s: %dKB window in partition %d\r\n", __func__, kb, partition);
+    #endif
+}
+
+void prefetchAttach(SceUID fd, const char *path)
+{
+    int attached = 0;
+
+    if(g_prefetchBuf == NULL || fd < 0 || strlen(path) >= sizeof(g_streamPath))
+    {
+        return;
+    }
+
+    sceKernelWaitSema(g_prefetchLock, 1, NULL);
+
+    // pops keeps the EBOOT it streams from open, later opens are short lived
+    if(g_streamFd < 0)
+    {
+        strcpy(g_streamPath, path);
+        g_streamFd = fd;
+        g_streamGen++;
+        g_pathGen++;
+        g_bufStart = g_bufValid = 0;
+        g_ahead = PREFETCH_AHEAD_MIN;
+        g_streamEof = 1; // until the game reads sequentially
+        attached = 1;
+    }
+
+    sceKernelSignalSema(g_prefetchLock, 1);
+
+    if(attached)
+    {
+        g_lastEnd = 0;
+        g_sequential = 0;
+    }
+}
+
+void prefetchDetach(SceUID fd)
+{
+    if(g_prefetchBuf == NULL || fd != g_streamFd)
+    {
+        return;
+    }
+
+    sceKernelWaitSema(g_prefetchLock, 1, NULL);
+    g_streamFd = -1;
+    g_streamGen++;
+    g_bufValid = 0;
+    sceKernelSignalSema(g_prefetchLock, 1);
+
+    // lets the thread close its fd
+    sceKernelSignalSema(g_prefetchWake, 1);
+}
+
+int prefetchRead(SceUID fd, void *buf, u32 pos, int size)
+{
+    SceUInt timeout = PREFETCH_WAIT_US;
+    u32 slot, first;
+    int hit, wake, waited = 0;
+
+    if(g_prefetchBuf == NULL || fd != g_streamFd || size <= 0)
+    {
+        return -1;
+    }
+
+    sceKernelWaitSema(g_prefetchLock, 1, NULL);
+
+    while(pos >= g_bufStart && pos + size > g_bufStart + g_bufValid && willFill(pos + size) && waited >= 0)
+    {
+        if(g_waiters++ == 0 || pos + size > g_wantEnd)
+        {
+            g_wantEnd = pos + size;
+        }
+
+        sceKernelSignalSema(g_prefetchLock, 1);
+        waited = sceKernelWaitSema(g_prefetchFilled, 1, &timeout);
+        sceKernelWaitSema(g_prefetchLock, 1, NULL);
+        g_waiters--;
+    }
+
+    hit = (pos >= g_bufStart && pos + size <= g_bufStart + g_bufValid);
+    g_readers += hit;
+    sceKernelSignalSema(g_prefetchLock, 1);
+
+    if(!hit)
+    {
+        return -1;
+    }
+
+    // the thread starts no read while g_readers is set, so the range stays put
+    slot = pos % g_prefetchStats.window;
+    first = g_prefetchStats.window - slot;
+    first = first < (u32)size ? first : (u32)size;
+    memcpy(buf, g_prefetchBuf + slot, first);
+    memcpy((u8*)buf + first, g_prefetchBuf, size - first);
+
+    sceKernelWaitSema(g_prefetchLock, 1, NULL);
+    g_readers--;
+    g_prefetchStats.hits++;
+    g_prefetchStats.served += size;
+    consumeTo(pos + size);
+    wake = (g_readers == 0 && needsFill());
+    sceKernelSignalSema(g_prefetchLock, 1);
+
+    g_lastEnd = pos + size;
+
+    if(wake)
+    {
+        sceKernelSignalSema(g_prefetchWake, 1);
+    }
+
+    return size;
+}
+
+void prefetchNoteRead(SceUID fd, u32 pos, int ret)
+{
+    u32 end;
+
+    if(g_prefetchBuf == NULL || fd != g_streamFd)
+    {
+        return;
+    }
+
+    g_prefetchStats.misses++;
+
+    if(ret <= 0)
+    {
+        return;
+    }
+
+    g_sequential = (pos == g_lastEnd) ? g_sequential + 1 : 0;
+    end = g_lastEnd = pos + ret;
+
+    if(g_sequential < PREFETCH_SEQUENTIAL)
+    {
+        return;
+    }
+
+    sceKernelWaitSema(g_prefetchLock, 1, NULL);
+
+    if(!g_streamEof && end > g_bufStart + g_bufValid && end <= g_bufStart + g_bufValid + g_ahead)
+    {
+        // the game outran the read ahead, give it more room
+        restartAt(end, g_ahead * 2);
+    }
+    else if(end < g_bufStart || end > g_bufStart + g_bufValid || g_streamEof)
+    {
+        // a new sequential run, or one past a finished window
+        restartAt(end, PREFETCH_AHEAD_MIN);
+    }
+    else
+    {
+        consumeTo(end);
+    }
+
+    sceKernelSignalSema(g_prefetchLock, 1);
+    sceKernelSignalSema(g_prefetchWake, 1);
+}
+
+int popcornGetPrefetchStats(PopcornPrefetchStats *stats)
+{
+    u32 k1;
+
+    if(stats == NULL || !isK1Buffer(stats, sizeof(*stats)))
+    {
+        return -1;
+    }
+
+    k1 = pspSdkSetK1(0);
+    memcpy(stats, &g_prefetchStats, sizeof(*stats));
+    pspSdkSetK1(k1);
+
+    return g_prefetchBuf != NULL ? 0 : -1;
+}
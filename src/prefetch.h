@@ -0,0 +1,51 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <psptypes.h>
+
+typedef struct
+{
+    u32 window; // bytes, 0 = disabled
+    u32 hits; // reads served from the staging buffer
+    u32 misses; // reads of the streamed EBOOT that went to the file
+    u32 restarts; // sequential runs detected
+    u64 served; // bytes served from the staging buffer
+    u64 prefetched; // bytes read ahead by the thread
+} PopcornPrefetchStats;
+
+// sizes the staging buffer from seplugins/popcorn.ini, prefetch_kb = 0 disables it
+void prefetchInit(void);
+
+// the EBOOT fd reads are prefetched for, path is reopened by the thread;
+// ignored while another fd is attached
+void prefetchAttach(SceUID fd, const char *path);
+void prefetchDetach(SceUID fd);
+
+// Copies [pos, pos+size) to buf when the staging buffer holds all of it and
+// returns size, otherwise returns -1 and the read has to go to the file.
+int prefetchRead(SceUID fd, void *buf, u32 pos, int size);
+
+// feeds a read that went to the file to the sequential access detection
+void prefetchNoteRead(SceUID fd, u32 pos, int ret);
+
+// PopcornPrivate export
+int popcornGetPrefetchStats(PopcornPrefetchStats *stats);
+
+#endif
@@ -0,0 +1,434 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#include <string.h>
+#include <stddef.h>
+#include <pspkernel.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "config.h"
+#include "sigscan.h"
+
+// Signatures are grouped by mask and hashed on their masked first word, so
+// each scanned word costs one lookup per distinct mask no matter how many
+// signatures there are. Most tables only use a full mask and an opcode mask.
+#define SIG_MAX_MASKS 4
+#define SIG_HASH_BITS 8
+#define SIG_HASH_SIZE (1 << SIG_HASH_BITS)
+
+// kept off the stack, module loads and so scans never run concurrently
+static u8 g_sigHeads[SIG_MAX_MASKS][SIG_HASH_SIZE];
+
+// patch location cache, two records per set picked by the text hash
+#define SIG_CACHE_NAME "popcorn_text.cache"
+#define SIG_CACHE_MAGIC 0x4C435350 // PSCL
+#define SIG_CACHE_VERSION 1
+#define SIG_CACHE_SETS 16
+#define SIG_CACHE_WAYS 2
+#define SIG_CACHE_MAX_MATCHES 26
+
+#define XXH_PRIME1 0x9E3779B1
+#define XXH_PRIME2 0x85EBCA77
+#define XXH_PRIME3 0xC2B2AE3D
+#define XXH_PRIME4 0x27D4EB2F
+#define XXH_PRIME5 0x165667B1
+
+typedef struct
+{
+    // key, a record is only valid if all of it matches
+    u32 magic;
+    u32 version;
+    u32 text_hash;
+    u32 text_size;
+    u32 table_hash;
+    u32 reserved;
+    // accepted matches in scan order, (signature index << 24) | word offset
+    u32 count;
+    u32 matches[SIG_CACHE_MAX_MATCHES];
+} SigCacheRecord;
+
+static inline u32 sigHash(u32 word)
+{
+    return (word * 0x9E3779B1) >> (32 - SIG_HASH_BITS);
+}
+
+static int checkContext(const Signature *sig, u32 addr, u32 text_addr, u32 text_end)
+{
+    int i;
+
+    for(i=0; i<SIG_MAX_CHECKS; i++)
+    {
+        const SigCheck *check = &sig->checks[i];
+        u32 at = addr + check->offset;
+
+        if(check->mask == 0)
+        {
+            continue;
+        }
+
+        if(at < text_addr || at + 4 > text_end || (_lw(at) & check->mask) != check->value)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int countMissing(Signature *sigs, int count)
+{
+    int i, missing = 0;
+
+    for(i=0; i<count; i++)
+    {
+        if(sigs[i].expected > 0 && sigs[i].found < sigs[i].expected)
+        {
+            #if DEBUG >= 3
+            printk("%s: signature 0x%08X matched %d/%d\r\n", __func__, (uint)sigs[i].value, sigs[i].found, sigs[i].expected);
+            #endif
+            missing++;
+        }
+    }
+
+    return missing;
+}
+
+// record, if not NULL, collects every accepted match for the location cache
+static int scanText(u32 text_addr, u32 text_size, Signature *sigs, int count, SigCacheRecord *record)
+{
+    u8 (*heads)[SIG_HASH_SIZE] = g_sigHeads;
+    u8 next[SIG_MAX_SIGNATURES];
+    u32 masks[SIG_MAX_MASKS];
+    u32 text_end = text_addr + text_size;
+    int nmasks = 0, pending = 0, unbounded = 0;
+    int i, g;
+    u32 addr;
+
+    if(count > SIG_MAX_SIGNATURES)
+    {
+        count = SIG_MAX_SIGNATURES;
+    }
+
+    memset(g_sigHeads, 0, sizeof(g_sigHeads));
+
+    for(i=0; i<count; i++)
+    {
+        Signature *sig = &sigs[i];
+
+        sig->found = 0;
+        next[i] = 0xFF;
+
+        for(g=0; g<nmasks && masks[g] != sig->mask; g++);
+
+        if(g == nmasks)
+        {
+            if(nmasks == SIG_MAX_MASKS)
+            {
+                #if DEBUG >= 3
+                printk("%s: too many masks, dropping signature 0x%08X\r\n", __func__, (uint)sig->value);
+                #endif
+                continue;
+            }
+
+            masks[nmasks++] = sig->mask;
+        }
+
+        next[i] = g;
+
+        if(sig->expected > 0)
+        {
+            pending++;
+        }
+        else
+        {
+            unbounded = 1;
+        }
+    }
+
+    // chains are built backwards so signatures sharing a word keep table order
+    for(i=count-1; i>=0; i--)
+    {
+        u8 *slot;
+
+        if(next[i] == 0xFF)
+        {
+            continue;
+        }
+
+        slot = &heads[next[i]][sigHash(sigs[i].value & sigs[i].mask)];
+        next[i] = *slot;
+        *slot = i + 1;
+    }
+
+    for(addr=text_addr; addr+4<=text_end; addr+=4)
+    {
+        u32 data = _lw(addr);
+
+        for(g=0; g<nmasks; g++)
+        {
+            int j;
+
+            for(j=heads[g][sigHash(data & masks[g])]; j; j=next[j-1])
+            {
+                Signature *sig = &sigs[j-1];
+
+                if((data & sig->mask) != sig->value)
+                {
+                    continue;
+                }
+
+                if(sig->expected > 0 && sig->found >= sig->expected)
+                {
+                    continue;
+                }
+
+                if(!checkContext(sig, addr, text_addr, text_end))
+                {
+                    continue;
+                }
+
+                if(sig->action != NULL && !(*sig->action)(sig, addr))
+                {
+                    continue;
+                }
+
+                sig->found++;
+
+                if(record != NULL)
+                {
+                    if(record->count < SIG_CACHE_MAX_MATCHES)
+                    {
+                        record->matches[record->count] = ((j-1) << 24) | ((addr - text_addr) >> 2);
+                    }
+
+                    record->count++;
+                }
+
+                if(sig->expected > 0 && sig->found == sig->expected && --pending == 0 && !unbounded)
+                {
+                    goto exit;
+                }
+
+                // one match per word, the action may have rewritten it
+                goto next_word;
+            }
+        }
+
+    next_word:
+        ;
+    }
+
+exit:
+    return countMissing(sigs, count);
+}
+
+int sigScan(u32 text_addr, u32 text_size, Signature *sigs, int count)
+{
+    return scanText(text_addr, text_size, sigs, count, NULL);
+}
+
+static inline u32 rotl(u32 x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+// xxHash32 of a word aligned range
+static u32 hashText(u32 addr, u32 size, u32 seed)
+{
+    u32 end = addr + size;
+    u32 h;
+
+    if(size >= 16)
+    {
+        u32 v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        u32 v2 = seed + XXH_PRIME2;
+        u32 v3 = seed;
+        u32 v4 = seed - XXH_PRIME1;
+
+        for(; addr+16<=end; addr+=16)
+        {
+            v1 = rotl(v1 + _lw(addr) * XXH_PRIME2, 13) * XXH_PRIME1;
+            v2 = rotl(v2 + _lw(addr + 4) * XXH_PRIME2, 13) * XXH_PRIME1;
+            v3 = rotl(v3 + _lw(addr + 8) * XXH_PRIME2, 13) * XXH_PRIME1;
+            v4 = rotl(v4 + _lw(addr + 12) * XXH_PRIME2, 13) * XXH_PRIME1;
+        }
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    }
+    else
+    {
+        h = seed + XXH_PRIME5;
+    }
+
+    h += size;
+
+    for(; addr+4<=end; addr+=4)
+    {
+        h = rotl(h + _lw(addr) * XXH_PRIME3, 17) * XXH_PRIME4;
+    }
+
+    for(; addr<end; addr++)
+    {
+        h = rotl(h + _lb(addr) * XXH_PRIME5, 11) * XXH_PRIME1;
+    }
+
+    h ^= h >> 15;
+    h *= XXH_PRIME2;
+    h ^= h >> 13;
+    h *= XXH_PRIME3;
+    h ^= h >> 16;
+
+    return h;
+}
+
+// everything in the table that decides where matches are, but not the actions
+static u32 hashTable(const Signature *sigs, int count)
+{
+    u32 hash = 0x811C9DC5;
+    int i, k;
+
+    for(i=0; i<count; i++)
+    {
+        u32 words[3 + 3 * SIG_MAX_CHECKS];
+
+        words[0] = sigs[i].value;
+        words[1] = sigs[i].mask;
+        words[2] = sigs[i].expected;
+
+        for(k=0; k<SIG_MAX_CHECKS; k++)
+        {
+            words[3 + 3 * k] = sigs[i].checks[k].offset;
+            words[4 + 3 * k] = sigs[i].checks[k].value;
+            words[5 + 3 * k] = sigs[i].checks[k].mask;
+        }
+
+        for(k=0; k<NELEMS(words); k++)
+        {
+            hash = (hash ^ words[k]) * 0x01000193;
+        }
+    }
+
+    return hash;
+}
+
+// both ways of the set the text hash maps to
+static int readCacheSet(const char *path, u32 set, SigCacheRecord *ways)
+{
+    SceUID fd = sceIoOpen(path, PSP_O_RDONLY, 0777);
+    int ret;
+
+    memset(ways, 0, SIG_CACHE_WAYS * sizeof(*ways));
+
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    sceIoLseek32(fd, set * SIG_CACHE_WAYS * sizeof(*ways), PSP_SEEK_SET);
+    ret = sceIoRead(fd, ways, SIG_CACHE_WAYS * sizeof(*ways));
+    sceIoClose(fd);
+
+    return ret;
+}
+
+int sigScanCached(u32 text_addr, u32 text_size, Signature *sigs, int count)
+{
+    SigCacheRecord ways[SIG_CACHE_WAYS];
+    SigCacheRecord key;
+    char path[64];
+    u32 set;
+    int i, way;
+
+    if(count > SIG_MAX_SIGNATURES)
+    {
+        count = SIG_MAX_SIGNATURES;
+    }
+
+    if(getPluginDataPath(SIG_CACHE_NAME, path, sizeof(path)) < 0)
+    {
+        return sigScan(text_addr, text_size, sigs, count);
+    }
+
+    // hashed before anything gets patched
+    memset(&key, 0, sizeof(key));
+    key.magic = SIG_CACHE_MAGIC;
+    key.version = SIG_CACHE_VERSION;
+    key.text_hash = hashText(text_addr, text_size, 0);
+    key.text_size = text_size;
+    key.table_hash = hashTable(sigs, count);
+
+    set = key.text_hash % SIG_CACHE_SETS;
+    readCacheSet(path, set, ways);
+
+    for(way=0; way<SIG_CACHE_WAYS; way++)
+    {
+        SigCacheRecord *record = &ways[way];
+
+        if(memcmp(record, &key, offsetof(SigCacheRecord, count)) != 0 || record->count > SIG_CACHE_MAX_MATCHES)
+        {
+            continue;
+        }
+
+        #if DEBUG >= 3
+        printk("%s: hit 0x%08X, %d matches\r\n", __func__, (uint)key.text_hash, (int)record->count);
+        #endif
+
+        for(i=0; i<count; i++)
+        {
+            sigs[i].found = 0;
+        }
+
+        for(i=0; i<record->count; i++)
+        {
+            u32 index = record->matches[i] >> 24;
+            u32 offset = (record->matches[i] & 0xFFFFFF) << 2;
+            Signature *sig;
+
+            if(index >= count || offset >= text_size)
+            {
+                continue;
+            }
+
+            sig = &sigs[index];
+
+            if(sig->action == NULL || (*sig->action)(sig, text_addr + offset))
+            {
+                sig->found++;
+            }
+        }
+
+        return countMissing(sigs, count);
+    }
+
+    #if DEBUG >= 3
+    printk("%s: miss 0x%08X\r\n", __func__, (uint)key.text_hash);
+    #endif
+
+    i = scanText(text_addr, text_size, sigs, count, &key);
+
+    if(key.count <= SIG_CACHE_MAX_MATCHES)
+    {
+        // take a free way, the second one if both are taken
+        for(way=0; way<SIG_CACHE_WAYS-1 && ways[way].magic == SIG_CACHE_MAGIC; way++);
+
+        writeCacheSlot(path, (set * SIG_CACHE_WAYS + way) * sizeof(key), &key, sizeof(key));
+    }
+
+    return i;
+}
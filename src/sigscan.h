@@ -0,0 +1,55 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#ifndef SIGSCAN_H
+#define SIGSCAN_H
+
+#include <psptypes.h>
+
+#define SIG_MAX_CHECKS 2
+#define SIG_MAX_SIGNATURES 32
+
+// word at a byte offset from the match that must also match, mask 0 = unused
+typedef struct
+{
+    int offset;
+    u32 value;
+    u32 mask;
+} SigCheck;
+
+typedef struct Signature
+{
+    u32 value;
+    u32 mask;
+    SigCheck checks[SIG_MAX_CHECKS];
+    // called for every match in address order, return 0 to reject the match
+    int (*action)(struct Signature *sig, u32 addr);
+    // matches after which the signature stops matching, 0 = every match
+    int expected;
+    int found;
+} Signature;
+
+// Scans [text_addr, text_addr+text_size) once for all signatures. Returns the
+// number of signatures with an expected count that they did not reach.
+int sigScan(u32 text_addr, u32 text_size, Signature *sigs, int count);
+
+// Same as sigScan, but looks the text up in the patch location cache first and
+// on a hit only runs the actions at the remembered locations. Actions must
+// therefore accept or reject a match based on the text alone.
+int sigScanCached(u32 text_addr, u32 text_size, Signature *sigs, int count);
+
+#endif
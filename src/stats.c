@@ -0,0 +1,100 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#include <string.h>
+#include <pspkernel.h>
+
+#include <cfwmacros.h>
+
+#include "stats.h"
+
+// Always on, so an update is a handful of adds without any locking. Hooks
+// running on different threads can rarely lose an update to each other,
+// which is fine for statistics.
+static const u32 g_hookNids[STATS_HOOKS] = {
+    0x109F50BC, // sceIoOpen
+    0x27EB27B8, // sceIoLseek
+    0x68963324, // sceIoLseek32
+    0x63632449, // sceIoIoctl
+    0x6A638D83, // sceIoRead
+    0xA0B5A7C2, // sceIoReadAsync
+    0xE23EEC33, // sceIoWaitAsync
+    0x35DBD746, // sceIoWaitAsyncCB
+    0x3251EA56, // sceIoPollAsync
+    0x42EC03AC, // sceIoWrite
+    0xACE946E8, // sceIoGetstat
+    0x810C4BC3, // sceIoClose
+    0x0090B2C8, // scePopsMan decompress, decompressData
+    0x0F9547E6, // sceNpDrmGetVersionKey
+    0x2AB4FE43, // sceMeAudio
+};
+
+static PopcornHookStats g_hookStats[STATS_HOOKS];
+
+void statsRecord(int hook, u32 bytes, int ret, u32 start)
+{
+    PopcornHookStats *stats = &g_hookStats[hook];
+    u32 us = sceKernelGetSystemTimeLow() - start;
+    int bucket = us ? 32 - __builtin_clz(us) : 0;
+
+    if(bucket >= STATS_BUCKETS)
+    {
+        bucket = STATS_BUCKETS - 1;
+    }
+
+    stats->calls++;
+    stats->bytes += bytes;
+    stats->total_us += us;
+    stats->histogram[bucket]++;
+
+    if(ret < 0)
+    {
+        stats->errors++;
+    }
+
+    if(us > stats->max_us)
+    {
+        stats->max_us = us;
+    }
+}
+
+int popcornGetHookCount(void)
+{
+    return STATS_HOOKS;
+}
+
+int popcornGetHookStats(int hook, PopcornHookStats *stats)
+{
+    u32 k1;
+
+    if(hook < 0 || hook >= STATS_HOOKS || stats == NULL || !isK1Buffer(stats, sizeof(*stats)))
+    {
+        return -1;
+    }
+
+    k1 = pspSdkSetK1(0);
+    memcpy(stats, &g_hookStats[hook], sizeof(*stats));
+    stats->nid = g_hookNids[hook];
+    pspSdkSetK1(k1);
+
+    return 0;
+}
+
+void popcornResetHookStats(void)
+{
+    memset(g_hookStats, 0, sizeof(g_hookStats));
+}
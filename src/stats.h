@@ -0,0 +1,80 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <psptypes.h>
+#include <pspsdk.h>
+
+// hooks with statistics, the first ones in the order of g_ioHooks
+enum
+{
+    STATS_IO_OPEN,
+    STATS_IO_LSEEK,
+    STATS_IO_LSEEK32,
+    STATS_IO_IOCTL,
+    STATS_IO_READ,
+    STATS_IO_READ_ASYNC,
+    STATS_IO_WAIT_ASYNC,
+    STATS_IO_WAIT_ASYNC_CB,
+    STATS_IO_POLL_ASYNC,
+    STATS_IO_WRITE,
+    STATS_IO_GETSTAT,
+    STATS_IO_CLOSE,
+    STATS_DECOMPRESS,
+    STATS_NPDRM_GET_VERSION_KEY,
+    STATS_MEAUDIO,
+    STATS_HOOKS,
+};
+
+// bucket 0 counts calls under 1us, bucket n calls of 2^(n-1) to 2^n-1 us and
+// the last bucket everything longer
+#define STATS_BUCKETS 16
+
+typedef struct
+{
+    u32 nid; // of the hooked import
+    u32 calls;
+    u32 errors; // calls that returned a negative value
+    u32 max_us;
+    u64 bytes;
+    u64 total_us;
+    u32 histogram[STATS_BUCKETS];
+} PopcornHookStats;
+
+void statsRecord(int hook, u32 bytes, int ret, u32 start);
+
+// every hook takes its start time on entry, for the statistics and the trace
+#define HOOK_BEGIN() u32 hook_start = sceKernelGetSystemTimeLow()
+#define HOOK_STATS(hook, bytes, ret) statsRecord(hook, bytes, ret, hook_start)
+
+// PopcornPrivate exports are syscalls: a caller in user mode has bit 31 of k1
+// set and may only hand in buffers that lie in user memory
+static inline int isK1Buffer(const void *buf, u32 size)
+{
+    u32 addr = (u32)buf;
+
+    return ((addr | (addr + size) | size) & pspSdkGetK1() & 0x80000000) == 0;
+}
+
+// PopcornPrivate exports
+int popcornGetHookCount(void);
+int popcornGetHookStats(int hook, PopcornHookStats *stats);
+void popcornResetHookStats(void);
+
+#endif
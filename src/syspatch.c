@@ -15,6 +15,7 @@
 * along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
 */
 
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -26,6 +27,18 @@
 #include <systemctrl.h>
 #include <systemctrl_private.h>
 
+#include "blockcache.h"
+#include "config.h"
+#include "inflate.h"
+#include "keystore.h"
+#include "lz4.h"
+#include "overlay.h"
+#include "patch.h"
+#include "prefetch.h"
+#include "sigscan.h"
+#include "stats.h"
+#include "trace.h"
+
 extern unsigned char g_icon_png[6108];
 
 STMOD_HANDLER g_previous = NULL;
@@ -35,6 +48,7 @@ int g_isCustomPBP;
 int g_icon0Status;
 
 static int g_keysBinFound;
+static int g_builtinInflate; // src/inflate.c instead of sceKernelDeflateDecompress
 static SceUID g_plain_doc_fd = -1;
 
 #define PGD_ID "XX0000-XXXX00000_00-XXXXXXXXXX000XXX"
@@ -63,22 +77,174 @@ typedef struct
     u32 psar_offset;
 } PBPHeader;
 
+// "_SLES_02080" and a terminator
+#define DISC_ID_SIZE 12
+
+// pops plays up to 5 discs, the PSTITLEIMG table has no room for more
+#define MAX_DISCS 5
+
+// the emulator config at PSISOIMG+0x420 runs up to the libcrypt word
+#define CONFIG_OFFSET 0x420
+#define LIBCRYPT_WORD_OFFSET 0x12B0
+#define CONFIG_MAX_SIZE (LIBCRYPT_WORD_OFFSET - CONFIG_OFFSET)
+
+// where the content ID sits in the DATA.PSP of a signed EBOOT
+#define DATA_PSP_CONTENT_ID 0x560
+
+// everything module_start needs from the EBOOT, gathered with a single open
+typedef struct
+{
+    int valid;
+    PBPHeader header;
+    char psar_magic[12];
+    u32 disc_table[MAX_DISCS]; // PSTITLEIMG+0x200, offsets relative to psar
+    u32 disc_found; // bit n set when disc n starts with the PSISOIMG magic
+    char disc_id[MAX_DISCS][DISC_ID_SIZE]; // PSISOIMG+0x400
+    int has_pgd_word;
+    u32 pgd_word; // PSTITLEIMG+0x200 or PSISOIMG+0x400
+    int has_icon0;
+    u8 icon0[40];
+    char content_id[KEY_STORE_ID_SIZE]; // DATA.PSP+0x560, empty when it isn't one
+} PbpProbe;
+
+// PBP header plus, for most EBOOTs, the start of ICON0 right behind PARAM.SFO
+#define PROBE_HEAD_SIZE 0x400
+// PSAR or PSISOIMG magic up to the PGD word and disc id at PSISOIMG+0x400
+#define PROBE_PSAR_SIZE (0x400 + DISC_ID_SIZE)
+
+// probe cache, one direct mapped slot per path hash
+#define PROBE_CACHE_NAME "popcorn.cache"
+#define PROBE_CACHE_MAGIC 0x48434350 // PCCH
+#define PROBE_CACHE_VERSION 5
+#define PROBE_CACHE_SLOTS 64
+
+typedef struct
+{
+    // key, an entry is only valid if all of it matches
+    u32 magic;
+    u32 version;
+    u32 path_hash;
+    u32 reserved;
+    SceOff size;
+    ScePspDateTime mtime;
+    // cached probe results
+    u32 is_custom;
+    s32 icon0_status;
+    u32 psiso_offsets[MAX_DISCS];
+    u32 disc_found;
+    char disc_id[MAX_DISCS][DISC_ID_SIZE];
+    u32 icon0_offset;
+    char content_id[KEY_STORE_ID_SIZE];
+    u32 padding[2];
+} ProbeCacheRecord;
+
 struct FunctionHook
 {
     unsigned int nid;
     void *fp;
 };
 
-// custom emulator config
-static u8 custom_config[0x400];
-static int config_size = 0;
-static int psiso_offsets[5] = {0, 0, 0, 0, 0}; // pops supports up to 5 discs, but config is the same for all of them even if it doesn't have to
+// every disc of the EBOOT that starts with the PSISOIMG magic
+typedef struct
+{
+    u32 offset; // PSISOIMG, absolute
+    int number; // 1 based position in the PSTITLEIMG table, names CONFIGn.BIN
+    char id[DISC_ID_SIZE]; // PSISOIMG+0x400
+    const u8 *config; // CONFIGn.BIN or the shared CONFIG.BIN, NULL without one
+    int config_size;
+    u32 libcrypt_word; // spliced at PSISOIMG+0x12B0
+} DiscInfo;
+
+static DiscInfo g_discs[MAX_DISCS]; // sorted by offset
+static int g_discCount;
+
+// custom emulator configs, read into one block that fits all of them
+static SceUID g_configBlock = -1;
+static u32 g_icon0Offset;
 
 static unsigned char g_keys[16];
+static char g_contentId[KEY_STORE_ID_SIZE];
+
+// KEYS.BIN or the key store is written by a low priority thread when the
+// version key changed, so the DRM callback never waits on the memory stick
+#define KEYS_WRITER_PRIORITY 0x70
+static int g_keysKnown; // g_keys is what KEYS.BIN holds or is about to
+static char g_keysContentId[KEY_STORE_ID_SIZE]; // title g_keys is stored for
+static u32 g_keysGeneration; // bumped for every new key
+static u32 g_keysWritten; // generation KEYS.BIN was last written with
+static SceUID g_keysWriteSema = -1;
+static SceUID g_keysWriter = -1;
+
+// KEYS.BIN and the key store are only read once a DRM hook asks for the key
+enum
+{
+    KEYS_UNREAD = 0,
+    KEYS_READING,
+    KEYS_READ,
+};
+
+static volatile int g_keysState;
+
+static PbpProbe g_probe;
+static ProbeCacheRecord g_probeKey;
+
+// IoFileMgr hands out small descriptors, anything above this is never tracked
+#define MAX_TRACKED_FDS 64
+
+// what myIoOpen opened an fd as, only FD_EBOOT reads are ever patched
+enum {
+    FD_OTHER = 0,
+    FD_EBOOT,
+    FD_DOCUMENT,
+    FD_MEMCARD,
+    FD_FAKE_RIF,
+    FD_FAKE_ACT,
+};
+
+// shadow of the file position and class of every fd opened through myIoOpen,
+// so the read hook knows where it is without asking IoFileMgr on every call
+typedef struct
+{
+    u8 opened;
+    u8 synced;
+    u8 kind; // FD_*
+    u8 lagging; // reads were served from the read ahead window, see syncFdPos
+    u32 pos;
+} FdPosition;
+
+static FdPosition g_fdPositions[MAX_TRACKED_FDS];
+
+// async read queued through myIoReadAsync, patched once its completion is observed
+typedef struct
+{
+    u8 pending;
+    unsigned char *buf;
+    u32 pos;
+    int size;
+} AsyncRead;
+
+static AsyncRead g_asyncReads[MAX_TRACKED_FDS];
+
+// pops opens only a few files with the PGD flag: the EBOOT, DOCUMENT.DAT and
+// the odd extra one
+#define DECRYPTED_CACHE_SLOTS 8
+
+typedef struct
+{
+    u32 hash;
+    u32 len; // 0 = empty slot
+    int decrypted;
+} DecryptedVerdict;
+
+static DecryptedVerdict g_decryptedCache[DECRYPTED_CACHE_SLOTS];
+static int g_decryptedNext;
 
 // Get keys.bin path
 static int getKeysBinPath(char *keypath, unsigned int size);
 
+// Load keys.bin or the key store entry
+static void getKeys(void);
+
 // Save keys.bin
 static int saveKeysBin(const char *keypath, unsigned char *key, int size);
 
@@ -140,304 +306,1025 @@ static inline int isEbootPBP(const char *path)
     return 0;
 }
 
-// check if we have a custom configuration that we can inject later on
-void readCustomConfig(){
-    int fd;
-    PBPHeader header;
-    char magic[12];
-    char configname[256];
-    char* ebootname = sceKernelInitFileName();
-    strcpy(configname, ebootname);
-    memset(psiso_offsets, 0, sizeof(psiso_offsets));
-
-    // open eboot.pbp and read header
-    fd = sceIoOpen(ebootname, PSP_O_RDONLY, 0777);
-    sceIoRead(fd, &header, sizeof(PBPHeader));
+// absolute offsets of the PSISOIMG of every disc in the probed EBOOT, zero
+// after the last one. The PSTITLEIMG table ends at its first entry that
+// isn't past the one before it.
+static void getDiscOffsets(u32 *offsets)
+{
+    memset(offsets, 0, MAX_DISCS * sizeof(*offsets));
 
-    // seek to start of psar and read its magic
-    sceIoLseek(fd, header.psar_offset, PSP_SEEK_SET);
-    sceIoRead(fd, magic, sizeof(magic));
+    if (!g_probe.valid) return;
     
-    if (strncmp(magic, "PSISOIMG", 8) == 0){
+    if (strncmp(g_probe.psar_magic, "PSISOIMG", 8) == 0){
         // single disc, starts at psaroffset itself
-        psiso_offsets[0] = header.psar_offset;
-    }
-    else if (strncmp(magic, "PSTITLEIMG", 10) == 0){
-        // multi disc, offsets are stored at psar+0x200
-        sceIoLseek(fd, header.psar_offset+0x0200, PSP_SEEK_SET);
-        sceIoRead(fd, psiso_offsets, sizeof(psiso_offsets));
-        // offsets are relative to psar, adjust to make them absolute
-        for (int i=0; i<NELEMS(psiso_offsets) && psiso_offsets[i]; i++){
-            psiso_offsets[i] += header.psar_offset;
-        }
+        offsets[0] = g_probe.header.psar_offset;
     }
+    else if (strncmp(g_probe.psar_magic, "PSTITLEIMG", 10) == 0){
+        // multi disc, offsets relative to psar are stored at psar+0x200
+        for (int i=0; i<MAX_DISCS && g_probe.disc_table[i]; i++){
+            u32 offset = g_probe.header.psar_offset + g_probe.disc_table[i];
+
+            if (offset <= g_probe.header.psar_offset || (i > 0 && offset <= offsets[i-1])){
+                #if DEBUG >= 3
+                printk("%s: disc table ends at bad entry %d 0x%08X\r\n", __func__, i, (uint)g_probe.disc_table[i]);
+                #endif
+                break;
+            }
 
-    sceIoClose(fd);
-
-    if (psiso_offsets[0] == 0) return; // at least one disc
+            offsets[i] = offset;
+        }
+    }
+}
 
-    // check if we have a custom config file alongside the eboot
-    char* slash = strrchr(configname, '/');
-    if (!slash) return;
+// check the PSISOIMG magic of every disc and keep its disc id for the
+// libcrypt lookup, buf holds the size bytes read from the start of the PSAR
+static void probeDiscs(SceUID fd, unsigned char *buf, int size)
+{
+    u32 offsets[MAX_DISCS];
 
-    strcpy(slash+1, "CONFIG.BIN");
+    getDiscOffsets(offsets);
 
-    fd = sceIoOpen(configname, PSP_O_RDONLY, 0777);
-    if (fd < 0) return;
+    for(int i=0; i<MAX_DISCS && offsets[i]; i++)
+    {
+        // a single disc EBOOT has its PSISOIMG at the PSAR, already read
+        if(offsets[i] != g_probe.header.psar_offset)
+        {
+            sceIoLseek32(fd, offsets[i], PSP_SEEK_SET);
+            size = sceIoRead(fd, buf, PROBE_PSAR_SIZE);
+        }
 
-    config_size = sceIoLseek(fd, 0, PSP_SEEK_END);
-    if (config_size <= 0) goto config_end;
-    
-    sceIoLseek(fd, 0, PSP_SEEK_SET);
-    sceIoRead(fd, custom_config, config_size);
+        if(size < PROBE_PSAR_SIZE || memcmp(buf, "PSISOIMG", 8) != 0)
+        {
+            continue;
+        }
 
-    config_end:
-    sceIoClose(fd);
+        g_probe.disc_found |= 1 << i;
+        memcpy(g_probe.disc_id[i], buf + 0x400, DISC_ID_SIZE - 1);
+    }
 }
 
-static int checkFileDecrypted(const char *filename)
+// read the parts of the EBOOT that readCustomConfig, isCustomPBP and getIcon0Status look at
+int probeEboot(void)
 {
-    SceUID fd = -1;
-    u32 k1;
-    int result = 0, ret;
-    u8 p[16 + 64], *buf;
-    u32 *magic;
+    SceUID fd;
+    const char *filename;
+    unsigned char p[PROBE_PSAR_SIZE + 64], *buf;
+    u32 pgd_offset;
+    int ret;
 
-    buf = (u8*)((((u32)p) & ~(64-1)) + 64);
+    buf = (unsigned char*)((((unsigned int)p) & ~(64-1)) + 64);
+    memset(&g_probe, 0, sizeof(g_probe));
+    filename = sceKernelInitFileName();
 
-    if(!g_isCustomPBP && isEbootPBP(filename))
+    if(filename == NULL)
     {
-        return 0;
+        return -1;
     }
 
-    k1 = pspSdkSetK1(0);
-
     fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
 
     if(fd < 0)
     {
-        goto exit;
+        #if DEBUG >= 3
+        printk("%s: sceIoOpen %s -> 0x%08X\r\n", __func__, filename, fd);
+        #endif
+        return fd;
     }
 
-    ret = sceIoRead(fd, buf, 16);
+    ret = sceIoRead(fd, buf, PROBE_HEAD_SIZE);
 
-    if(ret != 16)
+    if(ret < (int)sizeof(PBPHeader))
     {
+        #if DEBUG >= 3
+        printk("%s: sceIoRead -> 0x%08X\r\n", __func__, ret);
+        #endif
         goto exit;
     }
 
-    magic = (u32*)buf;
+    memcpy(&g_probe.header, buf, sizeof(PBPHeader));
 
-    // PGD
-    if(*magic == 0x44475000)
+    if(g_probe.header.icon0_offset <= ret - sizeof(g_probe.icon0))
     {
+        memcpy(g_probe.icon0, buf + g_probe.header.icon0_offset, sizeof(g_probe.icon0));
+        g_probe.has_icon0 = 1;
+    }
+    else
+    {
+        sceIoLseek32(fd, g_probe.header.icon0_offset, PSP_SEEK_SET);
+        g_probe.has_icon0 = (sceIoRead(fd, buf, sizeof(g_probe.icon0)) == sizeof(g_probe.icon0));
+        memcpy(g_probe.icon0, buf, sizeof(g_probe.icon0));
+    }
+
+    // the key store is looked up by it before pops reads the RIF
+    sceIoLseek32(fd, g_probe.header.elf_offset + DATA_PSP_CONTENT_ID, PSP_SEEK_SET);
+
+    if(sceIoRead(fd, buf, KEY_STORE_ID_SIZE) == KEY_STORE_ID_SIZE)
+    {
+        keyStoreContentId(g_probe.content_id, buf);
+    }
+
+    sceIoLseek32(fd, g_probe.header.psar_offset, PSP_SEEK_SET);
+    ret = sceIoRead(fd, buf, PROBE_PSAR_SIZE);
+
+    if(ret < (int)sizeof(g_probe.psar_magic))
+    {
+        #if DEBUG >= 3
+        printk("%s: sceIoRead -> 0x%08X\r\n", __func__, ret);
+        #endif
         goto exit;
     }
 
-    result = 1;
+    memcpy(g_probe.psar_magic, buf, sizeof(g_probe.psar_magic));
 
-exit:
-    if(fd >= 0)
+    if(0x200 + sizeof(g_probe.disc_table) <= ret)
     {
-        sceIoClose(fd);
+        memcpy(g_probe.disc_table, buf + 0x200, sizeof(g_probe.disc_table));
     }
 
-    pspSdkSetK1(k1);
+    pgd_offset = (0 == memcmp(buf, "PSTITLE", sizeof("PSTITLE")-1)) ? 0x200 : 0x400;
 
-    return result;
+    if(pgd_offset + sizeof(g_probe.pgd_word) <= ret)
+    {
+        memcpy(&g_probe.pgd_word, buf + pgd_offset, sizeof(g_probe.pgd_word));
+        g_probe.has_pgd_word = 1;
+    }
+
+    g_probe.valid = 1;
+    probeDiscs(fd, buf, ret);
+
+exit:
+    sceIoClose(fd);
+
+    return g_probe.valid ? 0 : -1;
 }
 
-static inline int isDocumentPath(const char *path)
+// fill the disc table from the PSTITLEIMG offsets and what was found at them
+static void setDiscs(const u32 *offsets, u32 found, char ids[][DISC_ID_SIZE])
 {
-    const char *p;
+    memset(g_discs, 0, sizeof(g_discs));
+    g_discCount = 0;
 
-    p = getFileBasename(path);
-    
-    if(p != NULL && 0 == strcmp(p, "DOCUMENT.DAT"))
-    {
-        return 1;
+    for (int i=0; i<MAX_DISCS; i++){
+        DiscInfo *disc;
+
+        if (offsets[i] == 0 || !(found & (1 << i))) continue;
+
+        disc = &g_discs[g_discCount++];
+        disc->offset = offsets[i];
+        disc->number = i + 1;
+        memcpy(disc->id, ids[i], DISC_ID_SIZE);
+        disc->id[DISC_ID_SIZE-1] = '\0';
     }
+}
 
-    return 0;
+// locate the PSISOIMG of every disc, the ICON0 and the content ID in the probed EBOOT
+void readDiscOffsets(void){
+    u32 offsets[MAX_DISCS];
+
+    getDiscOffsets(offsets);
+    setDiscs(offsets, g_probe.disc_found, g_probe.disc_id);
+    g_icon0Offset = g_probe.header.icon0_offset;
+    memcpy(g_contentId, g_probe.content_id, sizeof(g_contentId));
 }
 
-static int sceIoOpenPlain(const char *file, int flag, int mode)
-{
-    int ret;
+// drops the configs and the overlays that point into them
+static void freeCustomConfig(void){
+    overlayClear();
 
-    if(flag == 0x40000001 && checkFileDecrypted(file))
-    {
+    for (int i=0; i<g_discCount; i++){
+        g_discs[i].config = NULL;
+        g_discs[i].config_size = 0;
+    }
+
+    if (g_configBlock >= 0){
+        sceKernelFreePartitionMemory(g_configBlock);
+        g_configBlock = -1;
+    }
+}
+
+// open a config next to the EBOOT, positioned at its start, if it fits the
+// emulator's config region
+static SceUID openConfig(char *configname, char *slash, const char *name, int *size){
+    SceUID fd;
+
+    strcpy(slash+1, name);
+    fd = sceIoOpen(configname, PSP_O_RDONLY, 0777);
+    if (fd < 0) return fd;
+
+    *size = sceIoLseek32(fd, 0, PSP_SEEK_END);
+
+    if (*size <= 0 || *size > CONFIG_MAX_SIZE){
         #if DEBUG >= 3
-        printk("%s: removed PGD open flag\r\n", __func__);
+        printk("%s: %s has 0x%X bytes, at most 0x%X fit\r\n", __func__, name, *size, CONFIG_MAX_SIZE);
         #endif
-        ret = sceIoOpen(file, flag & ~0x40000000, mode);
+        sceIoClose(fd);
+        return -1;
+    }
 
-        if(ret >= 0 && isDocumentPath(file))
-        {
-            g_plain_doc_fd = ret;
+    sceIoLseek32(fd, 0, PSP_SEEK_SET);
+
+    return fd;
+}
+
+// check if we have custom configurations that we can inject later on: a
+// CONFIGn.BIN for disc n of a multi disc EBOOT, CONFIG.BIN for the others.
+// All of them go into one kernel block of their total size, which is only
+// allocated when there is a config at all. A CONFIGn.BIN that can't be read
+// is marked in unreadable and 1 is returned to load everything again with
+// CONFIG.BIN for that disc.
+static int loadCustomConfig(u32 *unreadable){
+    char configname[256];
+    char* ebootname = sceKernelInitFileName();
+    SceUID fds[MAX_DISCS+1]; // CONFIGn.BIN of every disc, then CONFIG.BIN
+    int sizes[MAX_DISCS+1];
+    const u8 *configs[MAX_DISCS+1];
+    int shared = g_discCount, total = 0, own = 0, retry = 0;
+    u8 *data = NULL;
+
+    freeCustomConfig();
+    if (g_discCount == 0) return 0; // at least one disc
+
+    strcpy(configname, ebootname);
+
+    // check if we have a custom config file alongside the eboot
+    char* slash = strrchr(configname, '/');
+    if (!slash || slash - configname > sizeof(configname) - sizeof("CONFIG5.BIN")) return 0;
+
+    for (int i=0; i<=shared; i++){
+        fds[i] = -1;
+        configs[i] = NULL;
+    }
+
+    // a single disc only has CONFIG.BIN, so it costs no extra open
+    if (g_discCount > 1 || g_discs[0].number > 1){
+        for (int i=0; i<g_discCount; i++){
+            char name[] = "CONFIG0.BIN";
+
+            if (*unreadable & (1 << i)) continue;
+
+            name[6] = '0' + g_discs[i].number;
+            fds[i] = openConfig(configname, slash, name, &sizes[i]);
+            own += (fds[i] >= 0);
         }
     }
-    else
-    {
-        ret = sceIoOpen(file, flag, mode);
+
+    if (own < g_discCount){
+        fds[shared] = openConfig(configname, slash, "CONFIG.BIN", &sizes[shared]);
     }
 
-    return ret;
-}
+    for (int i=0; i<=shared; i++){
+        if (fds[i] >= 0) total += sizes[i];
+    }
 
-static int myIoOpen(const char *file, int flag, int mode)
-{
-    int ret;
+    if (total == 0) return 0;
 
-    if(g_keysBinFound || g_isCustomPBP)
-    {
-        if(strstr(file, PGD_ID))
-        {
-            #if DEBUG >= 3
-            printk("%s: [FAKE]\r\n", __func__);
-            #endif
-            ret = RIF_MAGIC_FD;
-        } else if (0 == strcmp(file, ACT_DAT))
-        {
+    g_configBlock = sceKernelAllocPartitionMemory(PSP_MEMORY_PARTITION_KERNEL, "PopcornConfig", PSP_SMEM_Low, total, NULL);
+
+    if (g_configBlock >= 0){
+        data = sceKernelGetBlockHeadAddr(g_configBlock);
+    }
+    #if DEBUG >= 3
+    else printk("%s: no memory for 0x%X bytes of config\r\n", __func__, total);
+    #endif
+
+    for (int i=0; i<=shared; i++){
+        if (fds[i] < 0) continue;
+
+        if (data != NULL && sceIoRead(fds[i], data, sizes[i]) == sizes[i]){
+            configs[i] = data;
+            data += sizes[i];
+        }
+        else if (data != NULL && i < shared){
             #if DEBUG >= 3
-            printk("%s: [FAKE]\r\n", __func__);
+            printk("%s: cannot read the config of disc %d\r\n", __func__, g_discs[i].number);
             #endif
-            ret = ACT_DAT_FD;
-        } 
-        else
-        {
-            ret = sceIoOpenPlain(file, flag, mode);
-        }        
+            *unreadable |= 1 << i;
+            retry |= (fds[shared] < 0);
+        }
+
+        sceIoClose(fds[i]);
     }
-    else
-    {
-        ret = sceIoOpenPlain(file, flag, mode);
+
+    // CONFIG.BIN wasn't loaded because every disc had its own
+    if (retry){
+        freeCustomConfig();
+        return 1;
     }
 
-    #if DEBUG >= 3
-    printk("%s: %s 0x%08X -> 0x%08X\r\n", __func__, file, flag, ret);
-    #endif
+    for (int i=0; i<g_discCount; i++){
+        int n = configs[i] ? i : shared;
 
-    return ret;
+        if (configs[n] == NULL) continue;
+
+        g_discs[i].config = configs[n];
+        g_discs[i].config_size = sizes[n];
+    }
+
+    return 0;
 }
 
-static int myIoIoctl(SceUID fd, unsigned int cmd, void * indata, int inlen, void * outdata, int outlen)
+void readCustomConfig(){
+    u32 unreadable = 0;
+
+    while (loadCustomConfig(&unreadable));
+}
+
+// pops reads icon0 with the size patchIcon0Size gave it, a corrupted one is
+// only replaced when the read really got its PNG signature
+static void fillIcon0(const Overlay *overlay, u8 *dest, u32 offset, u32 size)
 {
-    int ret;
+    u32 png_signature = 0x474E5089;
 
-    #if DEBUG >= 3
-    if(cmd == 0x04100001)
+    if(g_icon0Status == ICON0_MISSING || ((g_icon0Status == ICON0_CORRUPTED) && 0 == memcmp(dest, &png_signature, 4)))
     {
-        printk("%s: setting PGD key\r\n", __func__);
+        #if DEBUG >= 3
+        printk("%s: fakes a PNG for icon0\r\n", __func__);
+        #endif
+        memcpy(dest, g_icon_png + offset, size);
     }
+}
 
-    if(cmd == 0x04100002)
-    {
-        printk("%s: setting PGD offset: 0x%08X\r\n", __func__, *(uint*)indata);
-    }
-    #endif
+// work out once what the read hook overlays on the EBOOT: the custom config at
+// PSISOIMG+0x420 and the anti-libcrypt magic word at PSISOIMG+0x12B0 of every
+// disc the probe found, and the fake icon0, so reads don't have to look at the
+// file again
+void buildPatchPlan(void)
+{
+    extern u32 searchMagicWord(char* discid);
 
-    if (g_isCustomPBP || (g_plain_doc_fd >= 0 && g_plain_doc_fd == fd))
-    {
-        if (cmd == 0x04100001)
-        {
-            ret = 0;
-            #if DEBUG >= 3
-            printk("%s: [FAKE] 0x%08X 0x%08X -> 0x%08X\r\n", __func__, fd, cmd, ret);
-            #endif
-            goto exit;
-        }
+    overlayClear();
 
-        if (cmd == 0x04100002)
-        {
-            ret = sceIoLseek32(fd, *(u32*)indata, PSP_SEEK_SET);
+    for (int i=0; i<g_discCount; i++){
+        DiscInfo *disc = &g_discs[i];
+        u32 mw;
 
-            #if DEBUG >= 3
-            if(ret < 0)
-            {
-                printk("%s: sceIoLseek32 -> 0x%08X\r\n", __func__, ret);
-            }
-            #endif
+        // copy custom config (if we have one), located at 0x420 after PSISOIMG
+        if (disc->config) overlayAdd(OVERLAY_EBOOT, disc->offset + CONFIG_OFFSET, disc->config_size, 0, disc->config, NULL);
 
-            ret = 0;
-            
-            #if DEBUG >= 3
-            printk("%s: [FAKE] 0x%08X 0x%08X -> 0x%08X\r\n", __func__, fd, cmd, ret);
-            #endif
-            goto exit;
+        // PSISOIMG+0x400 starts with the discid
+        mw = searchMagicWord(disc->id);
+        if (mw != 0){ // magic word found for this title
+            disc->libcrypt_word = mw ^ 0x72D0EE59; // needs to be xored with this constant
+            overlayAdd(OVERLAY_EBOOT, disc->offset + LIBCRYPT_WORD_OFFSET, sizeof(disc->libcrypt_word), 0, &disc->libcrypt_word, NULL);
         }
     }
 
-    ret = sceIoIoctl(fd, cmd, indata, inlen, outdata, outlen);
-
-exit:
-    #if DEBUG >= 3
-    printk("%s: 0x%08X -> 0x%08X\r\n", __func__, fd, ret);
-    #endif
-    return ret;
+    if(g_icon0Status != ICON0_OK && g_icon0Offset != 0)
+    {
+        overlayAdd(OVERLAY_EBOOT, g_icon0Offset, sizeof(g_icon_png), OVERLAY_EXACT, NULL, fillIcon0);
+    }
 }
 
-static int myIoGetstat(const char *path, SceIoStat *stat)
+static u32 hashPath(const char *path)
 {
-    int ret;
+    u32 hash = 0x811C9DC5;
 
-    if(g_keysBinFound || g_isCustomPBP)
+    while(*path)
     {
-        if(strstr(path, PGD_ID))
+        hash = (hash ^ (u8)*path++) * 0x01000193;
+    }
+
+    return hash;
+}
+
+// look the EBOOT up in the probe cache, on a hit the disc offsets, PBP type and
+// icon0 status are restored and the EBOOT doesn't have to be parsed at all
+int loadProbeCache(void)
+{
+    const char *ebootname = sceKernelInitFileName();
+    char cachepath[64];
+    ProbeCacheRecord record;
+    SceIoStat stat;
+    SceUID fd;
+    int ret;
+
+    memset(&g_probeKey, 0, sizeof(g_probeKey));
+
+    if(getPluginDataPath(PROBE_CACHE_NAME, cachepath, sizeof(cachepath)) < 0)
+    {
+        return -1;
+    }
+
+    if(sceIoGetstat(ebootname, &stat) < 0)
+    {
+        return -1;
+    }
+
+    g_probeKey.magic = PROBE_CACHE_MAGIC;
+    g_probeKey.version = PROBE_CACHE_VERSION;
+    g_probeKey.path_hash = hashPath(ebootname);
+    g_probeKey.size = stat.st_size;
+    memcpy(&g_probeKey.mtime, &stat.sce_st_mtime, sizeof(g_probeKey.mtime));
+
+    fd = sceIoOpen(cachepath, PSP_O_RDONLY, 0777);
+
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    sceIoLseek32(fd, (g_probeKey.path_hash % PROBE_CACHE_SLOTS) * sizeof(record), PSP_SEEK_SET);
+    ret = sceIoRead(fd, &record, sizeof(record));
+    sceIoClose(fd);
+
+    if(ret != sizeof(record) || memcmp(&record, &g_probeKey, offsetof(ProbeCacheRecord, is_custom)) != 0)
+    {
+        #if DEBUG >= 3
+        printk("%s: miss 0x%08X\r\n", __func__, (uint)g_probeKey.path_hash);
+        #endif
+        return -1;
+    }
+
+    setDiscs(record.psiso_offsets, record.disc_found, record.disc_id);
+    g_icon0Offset = record.icon0_offset;
+    memcpy(g_contentId, record.content_id, sizeof(g_contentId));
+    g_isCustomPBP = record.is_custom;
+    g_icon0Status = record.icon0_status;
+
+    #if DEBUG >= 3
+    printk("%s: hit 0x%08X\r\n", __func__, (uint)g_probeKey.path_hash);
+    #endif
+
+    return 0;
+}
+
+// remember what probing the EBOOT found, needs the key set up by loadProbeCache
+void saveProbeCache(void)
+{
+    char cachepath[64];
+    ProbeCacheRecord record;
+
+    if(g_probeKey.magic != PROBE_CACHE_MAGIC || !g_probe.valid)
+    {
+        return;
+    }
+
+    if(getPluginDataPath(PROBE_CACHE_NAME, cachepath, sizeof(cachepath)) < 0)
+    {
+        return;
+    }
+
+    memcpy(&record, &g_probeKey, sizeof(record));
+    record.is_custom = g_isCustomPBP;
+    record.icon0_status = g_icon0Status;
+
+    for(int i=0; i<g_discCount; i++)
+    {
+        int n = g_discs[i].number - 1;
+
+        record.psiso_offsets[n] = g_discs[i].offset;
+        record.disc_found |= 1 << n;
+        memcpy(record.disc_id[n], g_discs[i].id, DISC_ID_SIZE);
+    }
+    record.icon0_offset = g_icon0Offset;
+    memcpy(record.content_id, g_contentId, sizeof(record.content_id));
+
+    writeCacheSlot(cachepath, (g_probeKey.path_hash % PROBE_CACHE_SLOTS) * sizeof(record), &record, sizeof(record));
+}
+
+// Verdicts of checkFileDecrypted by path hash and length. Files don't change
+// while pops runs, so an entry stays valid until the module is unloaded; the
+// oldest one makes room when the table is full.
+static int lookupDecryptedVerdict(u32 hash, u32 len)
+{
+    unsigned int intr = sceKernelCpuSuspendIntr();
+    int result = -1;
+
+    for(int i=0; i<DECRYPTED_CACHE_SLOTS; i++)
+    {
+        if(g_decryptedCache[i].len != 0 && g_decryptedCache[i].hash == hash && g_decryptedCache[i].len == len)
         {
-            stat->st_mode = 0x21FF;
-            stat->st_attr = 0x20;
-            stat->st_size = 152;
-            ret = 0;
-            #if DEBUG >= 3
-            printk("%s: [FAKE]\r\n", __func__);
-            #endif
-        } else if (0 == strcmp(path, ACT_DAT))
+            result = g_decryptedCache[i].decrypted;
+            break;
+        }
+    }
+
+    sceKernelCpuResumeIntr(intr);
+
+    return result;
+}
+
+static void saveDecryptedVerdict(u32 hash, u32 len, int decrypted)
+{
+    unsigned int intr = sceKernelCpuSuspendIntr();
+    DecryptedVerdict *verdict = &g_decryptedCache[g_decryptedNext];
+
+    g_decryptedNext = (g_decryptedNext + 1) % DECRYPTED_CACHE_SLOTS;
+    verdict->hash = hash;
+    verdict->len = len;
+    verdict->decrypted = decrypted;
+    sceKernelCpuResumeIntr(intr);
+}
+
+// a custom EBOOT starts with its PBP header, pops reopening it with the PGD
+// flag doesn't have to look at it again
+void cacheEbootDecrypted(void)
+{
+    const char *ebootname = sceKernelInitFileName();
+
+    if(g_isCustomPBP && ebootname != NULL)
+    {
+        saveDecryptedVerdict(hashPath(ebootname), strlen(ebootname), 1);
+    }
+}
+
+static int checkFileDecrypted(const char *filename)
+{
+    SceUID fd = -1;
+    u32 k1, hash, len;
+    int result = 0, ret;
+    u8 p[16 + 64], *buf;
+    u32 *magic;
+
+    buf = (u8*)((((u32)p) & ~(64-1)) + 64);
+
+    if(!g_isCustomPBP && isEbootPBP(filename))
+    {
+        return 0;
+    }
+
+    hash = hashPath(filename);
+    len = strlen(filename);
+    ret = lookupDecryptedVerdict(hash, len);
+
+    if(ret >= 0)
+    {
+        return ret;
+    }
+
+    k1 = pspSdkSetK1(0);
+
+    fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
+
+    if(fd < 0)
+    {
+        goto exit;
+    }
+
+    ret = sceIoRead(fd, buf, 16);
+
+    if(ret != 16)
+    {
+        goto exit;
+    }
+
+    magic = (u32*)buf;
+
+    // PGD
+    result = (*magic != 0x44475000);
+    saveDecryptedVerdict(hash, len, result);
+
+exit:
+    if(fd >= 0)
+    {
+        sceIoClose(fd);
+    }
+
+    pspSdkSetK1(k1);
+
+    return result;
+}
+
+static inline int isDocumentPath(const char *path)
+{
+    const char *p;
+
+    p = getFileBasename(path);
+    
+    if(p != NULL && 0 == strcmp(p, "DOCUMENT.DAT"))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+// pops keeps each virtual memory card in SCEVMC0.VMP or SCEVMC1.VMP
+static inline int isMemcardPath(const char *path)
+{
+    const char *p;
+
+    p = getFileBasename(path);
+
+    if(p != NULL && 0 == strncmp(p, "SCEVMC", sizeof("SCEVMC")-1))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+static inline FdPosition *getFdPosition(SceUID fd)
+{
+    if(fd < 0 || fd >= MAX_TRACKED_FDS)
+    {
+        return NULL;
+    }
+
+    return &g_fdPositions[fd];
+}
+
+static void trackFdOpen(SceUID fd, int flag)
+{
+    FdPosition *fp = getFdPosition(fd);
+
+    if(fp == NULL)
+    {
+        return;
+    }
+
+    // appending opens don't start at 0, learn the position on the first read
+    fp->opened = 1;
+    fp->synced = (flag & PSP_O_APPEND) ? 0 : 1;
+    fp->pos = 0;
+}
+
+// remember what file fd is so reads only run the patches meant for it
+static void classifyFd(SceUID fd, const char *file)
+{
+    FdPosition *fp = getFdPosition(fd);
+    const char *ebootname;
+
+    if(fp == NULL)
+    {
+        return;
+    }
+
+    ebootname = sceKernelInitFileName();
+
+    if(isEbootPBP(file) || (ebootname != NULL && 0 == strcmp(file, ebootname)))
+    {
+        fp->kind = FD_EBOOT;
+    }
+    else if(isDocumentPath(file))
+    {
+        fp->kind = FD_DOCUMENT;
+    }
+    else if(isMemcardPath(file))
+    {
+        fp->kind = FD_MEMCARD;
+    }
+    else
+    {
+        fp->kind = FD_OTHER;
+    }
+}
+
+static inline int getFdKind(SceUID fd)
+{
+    FdPosition *fp;
+
+    if(fd == RIF_MAGIC_FD)
+    {
+        return FD_FAKE_RIF;
+    }
+
+    if(fd == ACT_DAT_FD)
+    {
+        return FD_FAKE_ACT;
+    }
+
+    fp = getFdPosition(fd);
+
+    return fp != NULL ? fp->kind : FD_OTHER;
+}
+
+static void trackFdSeek(SceUID fd, SceOff pos)
+{
+    FdPosition *fp = getFdPosition(fd);
+
+    if(fp == NULL || !fp->opened)
+    {
+        return;
+    }
+
+    // a failed seek leaves the position alone, lagging or not
+    if(pos < 0)
+    {
+        fp->synced = fp->lagging;
+        return;
+    }
+
+    fp->synced = 1;
+    fp->lagging = 0;
+    fp->pos = (u32)pos;
+}
+
+static inline AsyncRead *getAsyncRead(SceUID fd)
+{
+    if(fd < 0 || fd >= MAX_TRACKED_FDS)
+    {
+        return NULL;
+    }
+
+    return &g_asyncReads[fd];
+}
+
+// current position of fd, only asks IoFileMgr when the shadow can't tell
+static u32 getFdPos(SceUID fd)
+{
+    FdPosition *fp = getFdPosition(fd);
+    int pos;
+
+    if(fp != NULL && fp->opened && fp->synced)
+    {
+        return fp->pos;
+    }
+
+    pos = sceIoLseek32(fd, 0, SEEK_CUR);
+    trackFdSeek(fd, pos);
+
+    return pos;
+}
+
+static inline void unsyncFd(SceUID fd)
+{
+    FdPosition *fp = getFdPosition(fd);
+
+    if(fp != NULL)
+    {
+        fp->synced = 0;
+    }
+}
+
+// Reads served from the read ahead window don't move the real file position,
+// it is only brought up to the shadow before IoFileMgr relies on it.
+static void syncFdPos(SceUID fd)
+{
+    FdPosition *fp = getFdPosition(fd);
+
+    if(fp != NULL && fp->lagging)
+    {
+        fp->lagging = 0;
+        sceIoLseek(fd, fp->pos, PSP_SEEK_SET);
+    }
+}
+
+// The first caller reads the key, others that come in meanwhile wait for it.
+// Only hooks may call this: getKeys goes to the firmware directly, so nothing
+// it calls comes back here on the reading thread, which would wait forever.
+static int keysFound(void)
+{
+    unsigned int intr;
+    int state;
+
+    if(g_keysState == KEYS_READ)
+    {
+        return g_keysBinFound;
+    }
+
+    intr = sceKernelCpuSuspendIntr();
+    state = g_keysState;
+
+    if(state == KEYS_UNREAD)
+    {
+        g_keysState = KEYS_READING;
+    }
+
+    sceKernelCpuResumeIntr(intr);
+
+    if(state == KEYS_UNREAD)
+    {
+        getKeys();
+        g_keysState = KEYS_READ;
+    }
+
+    while(g_keysState != KEYS_READ)
+    {
+        sceKernelDelayThread(1000);
+    }
+
+    return g_keysBinFound;
+}
+
+// files that are faked when there is a key but no RIF
+static int isDrmPath(const char *path)
+{
+    return strstr(path, PGD_ID) != NULL || strcmp(path, ACT_DAT) == 0;
+}
+
+// flag is updated to what the file was opened with
+static int sceIoOpenPlain(const char *file, int *flag, int mode)
+{
+    int ret;
+
+    if(*flag == 0x40000001 && checkFileDecrypted(file))
+    {
+        #if DEBUG >= 3
+        printk("%s: removed PGD open flag\r\n", __func__);
+        #endif
+        *flag &= ~0x40000000;
+        ret = sceIoOpen(file, *flag, mode);
+
+        if(ret >= 0 && isDocumentPath(file))
+        {
+            g_plain_doc_fd = ret;
+        }
+    }
+    else
+    {
+        ret = sceIoOpen(file, *flag, mode);
+    }
+
+    return ret;
+}
+
+static int myIoOpen(const char *file, int flag, int mode)
+{
+    int ret, openFlag = flag;
+    HOOK_BEGIN();
+
+    if(isDrmPath(file) && (g_isCustomPBP || keysFound()))
+    {
+        #if DEBUG >= 3
+        printk("%s: [FAKE]\r\n", __func__);
+        #endif
+        ret = strstr(file, PGD_ID) ? RIF_MAGIC_FD : ACT_DAT_FD;
+    }
+    else
+    {
+        ret = sceIoOpenPlain(file, &openFlag, mode);
+        trackFdOpen(ret, flag);
+    }
+
+    if(ret >= 0 && ret != RIF_MAGIC_FD && ret != ACT_DAT_FD)
+    {
+        classifyFd(ret, file);
+
+        // the thread reads through a plain fd, a PGD one sees other data
+        if(getFdKind(ret) == FD_EBOOT && (openFlag & 0x40000000) == 0)
+        {
+            prefetchAttach(ret, file);
+        }
+    }
+
+    HOOK_STATS(STATS_IO_OPEN, 0, ret);
+    TRACE_PATH(TRACE_IO_OPEN, ret, file, ret, flag);
+
+    return ret;
+}
+
+static int myIoIoctl(SceUID fd, unsigned int cmd, void * indata, int inlen, void * outdata, int outlen)
+{
+    int ret;
+    HOOK_BEGIN();
+
+    if (g_isCustomPBP || (g_plain_doc_fd >= 0 && g_plain_doc_fd == fd))
+    {
+        if (cmd == 0x04100001)
         {
-            stat->st_mode = 0x21FF;
-            stat->st_attr = 0x20;
-            stat->st_size = 4152;
             ret = 0;
+            goto exit;
+        }
+
+        if (cmd == 0x04100002)
+        {
+            ret = sceIoLseek32(fd, *(u32*)indata, PSP_SEEK_SET);
+            trackFdSeek(fd, ret);
+
             #if DEBUG >= 3
-            printk("%s: [FAKE]\r\n", __func__);
+            if(ret < 0)
+            {
+                printk("%s: sceIoLseek32 -> 0x%08X\r\n", __func__, ret);
+            }
             #endif
-        } 
-        else
-        {
-            ret = sceIoGetstat(path, stat);
+
+            ret = 0;
+            goto exit;
         }
-    } 
+    }
+
+    syncFdPos(fd);
+    ret = sceIoIoctl(fd, cmd, indata, inlen, outdata, outlen);
+
+    // PGD ioctls move the underlying position behind our back
+    unsyncFd(fd);
+
+exit:
+    // the PGD offset is traced as the position
+    HOOK_STATS(STATS_IO_IOCTL, 0, ret);
+    TRACE(TRACE_IO_IOCTL, fd, cmd == 0x04100002 ? *(u32*)indata : 0, inlen, ret, cmd);
+    return ret;
+}
+
+static int myIoGetstat(const char *path, SceIoStat *stat)
+{
+    int ret;
+    HOOK_BEGIN();
+
+    if(isDrmPath(path) && (g_isCustomPBP || keysFound()))
+    {
+        stat->st_mode = 0x21FF;
+        stat->st_attr = 0x20;
+        stat->st_size = strstr(path, PGD_ID) ? 152 : 4152;
+        ret = 0;
+        #if DEBUG >= 3
+        printk("%s: [FAKE]\r\n", __func__);
+        #endif
+    }
     else
     {
         ret = sceIoGetstat(path, stat);
     }
-    #if DEBUG >= 3
-    printk("%s: %s -> 0x%08X\r\n", __func__, path, ret);
-    #endif
+    HOOK_STATS(STATS_IO_GETSTAT, 0, ret);
+    TRACE_PATH(TRACE_IO_GETSTAT, -1, path, ret, 0);
     return ret;
 }
 
-static int myIoRead(int fd, unsigned char *buf, int size)
+// apply every read patch to data that was read from the EBOOT at pos, returns
+// the value the read should report to pops
+static int patchEbootRead(unsigned char *buf, int size, u32 pos, int ret)
+{
+    // inject custom config, anti-libcrypt and icon0, emulator normally reads a
+    // huge chunk of data starting at PSISOIMG+0x400 but any read covering them works
+    // more information about PSISOIMG: https://www.psdevwiki.com/psp/PSISOIMG0000
+    if(ret > 0)
+    {
+        overlayApply(OVERLAY_EBOOT, buf, pos, ret, size);
+    }
+
+    if(ret != size)
+    {
+        return ret;
+    }
+
+    if (size == 4)
+    {
+        u32 magic = 0x464C457F; // ~ELF
+
+        if(0 == memcmp(buf, &magic, sizeof(magic)))
+        {
+            magic = 0x5053507E; // ~PSP
+            memcpy(buf, &magic, sizeof(magic));
+            #if DEBUG >= 3
+            printk("%s: patch ~ELF -> ~PSP\r\n", __func__);
+            #endif
+        }
+
+        return size;
+    }
+    
+    if (g_isCustomPBP && size >= 0x420 && buf[0x41B] == 0x27 &&
+            buf[0x41C] == 0x19 &&
+            buf[0x41D] == 0x22 &&
+            buf[0x41E] == 0x41 &&
+            buf[0x41A] == buf[0x41F])
+    {
+        buf[0x41B] = 0x55;
+        #if DEBUG >= 3
+        printk("%s: unknown patch loc_6c\r\n", __func__);
+        #endif
+    }
+
+    return ret;
+}
+
+// reads the EBOOT from the read ahead window or the file
+static int readEboot(SceUID fd, unsigned char *buf, int size, u32 pos, int *served)
 {
     int ret;
+
+    ret = prefetchRead(fd, buf, pos, size);
+    *served = (ret >= 0);
+
+    if(!*served)
+    {
+        syncFdPos(fd);
+        ret = sceIoRead(fd, buf, size);
+        prefetchNoteRead(fd, pos, ret);
+    }
+
+    if(ret >= 0)
+    {
+        blockCacheNoteRead(buf, pos, ret);
+    }
+
+    return ret;
+}
+
+static int myIoRead(int fd, unsigned char *buf, int size)
+{
+    int ret, kind, served = 0;
     u32 pos;
     u32 k1;
+    HOOK_BEGIN();
 
     UNUSED(pos);
     k1 = pspSdkSetK1(0);
+    kind = getFdKind(fd);
 
-    if(fd != RIF_MAGIC_FD && fd != ACT_DAT_FD)
+    if(kind == FD_FAKE_RIF || kind == FD_FAKE_ACT)
     {
-        pos = sceIoLseek32(fd, 0, SEEK_CUR);
-    } 
+        pos = 0;
+    }
     else
     {
-        pos = 0;
+        pos = getFdPos(fd);
     }
     
     if(g_keysBinFound|| g_isCustomPBP)
     {
-        if(fd == RIF_MAGIC_FD)
+        if(kind == FD_FAKE_RIF)
         {
             size = 152;
             #if DEBUG >= 3
@@ -447,7 +1334,7 @@ static int myIoRead(int fd, unsigned char *buf, int size)
             strcpy((char*)(buf+0x10), PGD_ID);
             ret = size;
             goto exit;
-        } else if (fd == ACT_DAT_FD)
+        } else if (kind == FD_FAKE_ACT)
         {
             #if DEBUG >= 3
             printk("%s: fake act.dat content %d\r\n", __func__, size);
@@ -458,95 +1345,40 @@ static int myIoRead(int fd, unsigned char *buf, int size)
         }
     }
 
-    ret = sceIoRead(fd, buf, size);
-
-    // patch to inject custom config and anti-libcrypt
-    for (int i=0; i<NELEMS(psiso_offsets); i++){ // check each disc
-        int offset = psiso_offsets[i];
-        if (offset == 0) break;
-
-        // emulator reads a huge chunk of data starting at PSISOIMG+0x400
-        // more information about PSISOIMG: https://www.psdevwiki.com/psp/PSISOIMG0000
-        if (offset+0x400 == pos){ // read is within expected bounds
-            // seek to where we expect PSISOIMG magic to appear and read it
-            char magic[12];
-            sceIoLseek(fd, offset, PSP_SEEK_SET);
-            sceIoRead(fd, magic, sizeof(magic));
-            sceIoLseek(fd, pos+size, PSP_SEEK_SET); // seek back into where file descriptor is supposed to be
-
-            if (strncmp(magic, "PSISOIMG", 8) == 0){ // check for PSISOIMG magic number to make sure this is it
-
-                // copy custom config (if we have one), located at 0x420 after PSISOIMG, thus 0x20 after given buffer
-                if (config_size>0) memcpy(buf+0x20, custom_config, config_size);
-            
-                // anti-libcrypt patch, calculate libcrypt magic and inject at 0x12B0 after PSISOIMG, 0xEB0 after given buffer
-                extern u32 searchMagicWord(char* discid);
-                u32 mw = searchMagicWord((char*)buf); // buf points to PSISOIMG+0x0400, which conviniently starts with the discid
-                if (mw != 0){ // magic word found for this title
-                    mw ^= 0x72D0EE59; // needs to be xored with this constant
-                    memcpy(buf+0xeb0, &mw, sizeof(mw));
-                }
-            
-            }
-            break;
-        }
+    if(kind == FD_EBOOT)
+    {
+        ret = readEboot(fd, buf, size, pos, &served);
     }
-
-    if(ret != size)
+    else
     {
-        goto exit;
+        // memory cards, DOCUMENT.DAT and the rest are never patched
+        ret = sceIoRead(fd, buf, size);
     }
 
-    if (size == 4)
+    if(ret >= 0)
     {
-        u32 magic = 0x464C457F; // ~ELF
+        trackFdSeek(fd, pos + ret);
 
-        if(0 == memcmp(buf, &magic, sizeof(magic)))
+        // only EBOOT fds are served from the window, they all have a shadow
+        if(served)
         {
-            magic = 0x5053507E; // ~PSP
-            memcpy(buf, &magic, sizeof(magic));
-            #if DEBUG >= 3
-            printk("%s: patch ~ELF -> ~PSP\r\n", __func__);
-            #endif
+            getFdPosition(fd)->lagging = 1;
         }
-
-        ret = size;
-        goto exit;
     }
-    
-    if(size == sizeof(g_icon_png))
+    else
     {
-        u32 png_signature = 0x474E5089;
-
-        if(g_icon0Status == ICON0_MISSING || ((g_icon0Status == ICON0_CORRUPTED) && 0 == memcmp(buf, &png_signature, 4)))
-        {
-            #if DEBUG >= 3
-            printk("%s: fakes a PNG for icon0\r\n", __func__);
-            #endif
-            memcpy(buf, g_icon_png, size);
-
-            ret = size;
-            goto exit;
-        }
+        unsyncFd(fd);
     }
 
-    if (g_isCustomPBP && size >= 0x420 && buf[0x41B] == 0x27 &&
-            buf[0x41C] == 0x19 &&
-            buf[0x41D] == 0x22 &&
-            buf[0x41E] == 0x41 &&
-            buf[0x41A] == buf[0x41F])
+    if(kind == FD_EBOOT)
     {
-        buf[0x41B] = 0x55;
-        #if DEBUG >= 3
-        printk("%s: unknown patch loc_6c\r\n", __func__);
-        #endif
+        ret = patchEbootRead(buf, size, pos, ret);
     }
 
 exit:
     pspSdkSetK1(k1);
-    #if DEBUG >= 3
-    printk("%s: fd=0x%08X pos=0x%08X size=%d -> 0x%08X\r\n", __func__, (uint)fd, (uint)pos, (int)size, ret);
-    #endif
+    HOOK_STATS(STATS_IO_READ, ret > 0 ? ret : 0, ret);
+    TRACE(TRACE_IO_READ, fd, pos, size, ret, served);
     return ret;
 }
 
@@ -555,16 +1387,134 @@ static int myIoReadAsync(int fd, unsigned char *buf, int size)
     int ret;
     unsigned int pos;
     unsigned int k1;
+    AsyncRead *ar;
+    HOOK_BEGIN();
 
-    UNUSED(pos);
     k1 = pspSdkSetK1(0);
-    pos = sceIoLseek32(fd, 0, SEEK_CUR);
+    pos = getFdPos(fd);
+    syncFdPos(fd);
     pspSdkSetK1(k1);
     ret = sceIoReadAsync(fd, buf, size);
+
+    // the amount read is only known on completion
+    unsyncFd(fd);
+
+    ar = getAsyncRead(fd);
+
+    if(ar != NULL)
+    {
+        ar->pending = (ret >= 0);
+        ar->buf = buf;
+        ar->pos = pos;
+        ar->size = size;
+    }
     
+    HOOK_STATS(STATS_IO_READ_ASYNC, 0, ret);
+    TRACE(TRACE_IO_READ_ASYNC, fd, pos, size, ret, 0);
+    return ret;
+}
+
+// called with the result of a wait/poll on fd, patches the data of a finished
+// async read the same way myIoRead does
+static void completeAsyncRead(SceUID fd, int ret, SceInt64 *res)
+{
+    AsyncRead *ar = getAsyncRead(fd);
+    int result;
     #if DEBUG >= 3
-    printk("%s: 0x%08X 0x%08X 0x%08X -> 0x%08X\r\n", __func__, (uint)fd, (uint)pos, size, ret);
+    HOOK_BEGIN();
     #endif
+
+    // 1 means still in progress, negative means nothing was collected
+    if(ar == NULL || !ar->pending || ret != 0)
+    {
+        return;
+    }
+
+    ar->pending = 0;
+    result = (int)*res;
+
+    if(result >= 0)
+    {
+        trackFdSeek(fd, ar->pos + result);
+    }
+
+    if(getFdKind(fd) == FD_EBOOT)
+    {
+        if(result >= 0)
+        {
+            blockCacheNoteRead(ar->buf, ar->pos, result);
+        }
+
+        result = patchEbootRead(ar->buf, ar->size, ar->pos, result);
+        *res = result;
+    }
+
+    TRACE(TRACE_IO_ASYNC_DONE, fd, ar->pos, ar->size, result, 0);
+}
+
+static int myIoWaitAsync(SceUID fd, SceInt64 *res)
+{
+    int ret;
+    u32 k1;
+    SceInt64 result = 0;
+    HOOK_BEGIN();
+
+    k1 = pspSdkSetK1(0);
+    ret = sceIoWaitAsync(fd, &result);
+    completeAsyncRead(fd, ret, &result);
+    pspSdkSetK1(k1);
+
+    if(res != NULL)
+    {
+        *res = result;
+    }
+
+    // the bytes of an async read are counted when they are collected
+    HOOK_STATS(STATS_IO_WAIT_ASYNC, ret == 0 && result > 0 ? (u32)result : 0, ret);
+    return ret;
+}
+
+static int myIoWaitAsyncCB(SceUID fd, SceInt64 *res)
+{
+    int ret;
+    u32 k1;
+    SceInt64 result = 0;
+    HOOK_BEGIN();
+
+    k1 = pspSdkSetK1(0);
+    ret = sceIoWaitAsyncCB(fd, &result);
+    completeAsyncRead(fd, ret, &result);
+    pspSdkSetK1(k1);
+
+    if(res != NULL)
+    {
+        *res = result;
+    }
+
+    // the bytes of an async read are counted when they are collected
+    HOOK_STATS(STATS_IO_WAIT_ASYNC_CB, ret == 0 && result > 0 ? (u32)result : 0, ret);
+    return ret;
+}
+
+static int myIoPollAsync(SceUID fd, SceInt64 *res)
+{
+    int ret;
+    u32 k1;
+    SceInt64 result = 0;
+    HOOK_BEGIN();
+
+    k1 = pspSdkSetK1(0);
+    ret = sceIoPollAsync(fd, &result);
+    completeAsyncRead(fd, ret, &result);
+    pspSdkSetK1(k1);
+
+    if(res != NULL)
+    {
+        *res = result;
+    }
+
+    // the bytes of an async read are counted when they are collected
+    HOOK_STATS(STATS_IO_POLL_ASYNC, ret == 0 && result > 0 ? (u32)result : 0, ret);
     return ret;
 }
 
@@ -572,9 +1522,15 @@ static SceOff myIoLseek(SceUID fd, SceOff offset, int whence)
 {
     SceOff ret;
     u32 k1;
+    HOOK_BEGIN();
 
     k1 = pspSdkSetK1(0);
 
+    if(whence == PSP_SEEK_CUR)
+    {
+        syncFdPos(fd);
+    }
+
     if(g_keysBinFound || g_isCustomPBP)
     {
         if (fd == RIF_MAGIC_FD)
@@ -593,17 +1549,67 @@ static SceOff myIoLseek(SceUID fd, SceOff offset, int whence)
         else
         {
             ret = sceIoLseek(fd, offset, whence);
+            trackFdSeek(fd, ret);
         }
     } 
     else
     {
         ret = sceIoLseek(fd, offset, whence);
+        trackFdSeek(fd, ret);
     }
 
     pspSdkSetK1(k1);
-    #if DEBUG >= 3
-    printk("%s: 0x%08X 0x%08X 0x%08X -> 0x%08X\r\n", __func__, (uint)fd, (uint)offset, (uint)whence, (int)ret);
-    #endif
+    HOOK_STATS(STATS_IO_LSEEK, 0, ret < 0 ? -1 : 0);
+    TRACE(TRACE_IO_LSEEK, fd, (u32)offset, whence, (int)ret, 0);
+    return ret;
+}
+
+// not faked for the RIF/ACT descriptors, only hooked to keep the position shadow in sync
+static int myIoLseek32(SceUID fd, int offset, int whence)
+{
+    int ret;
+    u32 k1;
+    HOOK_BEGIN();
+
+    k1 = pspSdkSetK1(0);
+
+    if(whence == PSP_SEEK_CUR)
+    {
+        syncFdPos(fd);
+    }
+
+    ret = sceIoLseek32(fd, offset, whence);
+    trackFdSeek(fd, ret);
+    pspSdkSetK1(k1);
+    HOOK_STATS(STATS_IO_LSEEK32, 0, ret);
+    TRACE(TRACE_IO_LSEEK32, fd, offset, whence, ret, 0);
+    return ret;
+}
+
+static int myIoWrite(SceUID fd, const void *data, int size)
+{
+    int ret;
+    u32 k1;
+    FdPosition *fp;
+    HOOK_BEGIN();
+
+    k1 = pspSdkSetK1(0);
+    syncFdPos(fd);
+    ret = sceIoWrite(fd, data, size);
+    fp = getFdPosition(fd);
+
+    if(fp != NULL && fp->synced && ret >= 0)
+    {
+        fp->pos += ret;
+    }
+    else
+    {
+        unsyncFd(fd);
+    }
+
+    pspSdkSetK1(k1);
+    HOOK_STATS(STATS_IO_WRITE, ret > 0 ? ret : 0, ret);
+    TRACE(TRACE_IO_WRITE, fd, 0, size, ret, 0);
     return ret;
 }
 
@@ -611,6 +1617,7 @@ static int myIoClose(SceUID fd)
 {
     int ret;
     u32 k1;
+    HOOK_BEGIN();
 
     k1 = pspSdkSetK1(0);
 
@@ -644,19 +1651,39 @@ static int myIoClose(SceUID fd)
         g_plain_doc_fd = -1;
     }
 
+    if(ret == 0)
+    {
+        prefetchDetach(fd);
+    }
+
+    if(ret == 0 && fd != RIF_MAGIC_FD && fd != ACT_DAT_FD)
+    {
+        FdPosition *fp = getFdPosition(fd);
+
+        if(fp != NULL)
+        {
+            memset(fp, 0, sizeof(*fp));
+            memset(getAsyncRead(fd), 0, sizeof(AsyncRead));
+        }
+    }
+
     pspSdkSetK1(k1);
-    #if DEBUG >= 3
-    printk("%s: 0x%08X -> 0x%08X\r\n", __func__, fd, ret);
-    #endif
+    HOOK_STATS(STATS_IO_CLOSE, 0, ret);
+    TRACE(TRACE_IO_CLOSE, fd, 0, 0, ret, 0);
     return ret;
 }
 
 static struct FunctionHook g_ioHooks[] = {
     { 0x109F50BC, &myIoOpen, },
     { 0x27EB27B8, &myIoLseek, },
+    { 0x68963324, &myIoLseek32, },
     { 0x63632449, &myIoIoctl, },
     { 0x6A638D83, &myIoRead, },
     { 0xA0B5A7C2, &myIoReadAsync, },
+    { 0xE23EEC33, &myIoWaitAsync, },
+    { 0x35DBD746, &myIoWaitAsyncCB, },
+    { 0x3251EA56, &myIoPollAsync, },
+    { 0x42EC03AC, &myIoWrite, },
     { 0xACE946E8, &myIoGetstat, },
     { 0x810C4BC3, &myIoClose, },
 };
@@ -671,13 +1698,117 @@ static struct FunctionHook g_amctrlHooks[] = {
     { 0xF5186D8E, NULL},
 };
 
+// the key store takes the key when it is enabled and knows the title,
+// KEYS.BIN next to the EBOOT otherwise
+static int saveKeys(const char *id, unsigned char *key)
+{
+    char keypath[128];
+
+    if(id[0] != '\0' && keyStoreEnabled() && keyStoreInsert(id, key) == 0)
+    {
+        return 0;
+    }
+
+    if(getKeysBinPath(keypath, sizeof(keypath)) < 0)
+    {
+        return -1;
+    }
+
+    return saveKeysBin(keypath, key, sizeof(g_keys));
+}
+
+// writes the newest key once no higher priority thread needs the CPU, keys
+// that arrive while a write is going on are picked up by the next pass
+static int keysWriterThread(SceSize args, void *argp)
+{
+    char id[KEY_STORE_ID_SIZE];
+    unsigned char key[sizeof(g_keys)];
+    unsigned int intr;
+    u32 generation;
+    int ret;
+
+    while(1)
+    {
+        sceKernelWaitSema(g_keysWriteSema, 1, NULL);
+
+        intr = sceKernelCpuSuspendIntr();
+        generation = g_keysGeneration;
+        memcpy(key, g_keys, sizeof(key));
+        memcpy(id, g_keysContentId, sizeof(id));
+        sceKernelCpuResumeIntr(intr);
+
+        if(generation == g_keysWritten)
+        {
+            continue;
+        }
+
+        ret = saveKeys(id, key);
+        g_keysWritten = generation;
+
+        UNUSED(ret);
+        #if DEBUG >= 3
+        printk("%s: saveKeys -> %d\r\n", __func__, ret);
+        #endif
+    }
+
+    return 0;
+}
+
+// rif is the one the key was derived from, its content ID is the one the
+// key store files the key under
+static void scheduleKeysWrite(const unsigned char *key, const unsigned char *rif)
+{
+    char id[KEY_STORE_ID_SIZE];
+    unsigned int intr;
+    SceUID thid;
+
+    // the fake RIF carries PGD_ID, which looks like a content ID as well
+    if(rif == NULL || keyStoreContentId(id, rif + 0x10) < 0 || strcmp(id, PGD_ID) == 0)
+    {
+        memcpy(id, g_contentId, sizeof(id));
+    }
+
+    intr = sceKernelCpuSuspendIntr();
+    memcpy(g_keys, key, sizeof(g_keys));
+    memcpy(g_keysContentId, id, sizeof(g_keysContentId));
+    g_keysGeneration++;
+    g_keysKnown = 1;
+    sceKernelCpuResumeIntr(intr);
+
+    // the first new key starts the writer
+    if(g_keysWriteSema < 0)
+    {
+        g_keysWriteSema = sceKernelCreateSema("PopcornKeysWrite", 0, 0, 1, NULL);
+    }
+
+    if(g_keysWriter < 0 && g_keysWriteSema >= 0)
+    {
+        thid = sceKernelCreateThread("PopcornKeysWrite", keysWriterThread, KEYS_WRITER_PRIORITY, 0x1000, 0, NULL);
+
+        if(thid >= 0 && sceKernelStartThread(thid, 0, NULL) >= 0)
+        {
+            g_keysWriter = thid;
+        }
+    }
+
+    if(g_keysWriter < 0)
+    {
+        // no writer, save it right away like before
+        saveKeys(id, g_keys);
+        return;
+    }
+
+    sceKernelSignalSema(g_keysWriteSema, 1);
+}
+
 static int (*sceNpDrmGetVersionKey)(unsigned char * key, unsigned char * act, unsigned char * rif, unsigned int flags);
 static int _sceNpDrmGetVersionKey(unsigned char * key, unsigned char * act, unsigned char * rif, unsigned int flags)
 {
-    char keypath[128];
     int result;
+    HOOK_BEGIN();
 
     result = (*sceNpDrmGetVersionKey)(key, act, rif, flags);
+    keysFound();
 
     if (g_isCustomPBP)
     {
@@ -696,18 +1827,13 @@ static int _sceNpDrmGetVersionKey(unsigned char * key, unsigned char * act, unsi
     }
     else
     {
-        getKeysBinPath(keypath, sizeof(keypath));
-
         if (result == 0)
         {
-            int ret;
-
-            UNUSED(ret);
-            memcpy(g_keys, key, sizeof(g_keys));
-            ret = saveKeysBin(keypath, g_keys, sizeof(g_keys));
-            #if DEBUG >= 3
-            printk("%s: saveKeysBin -> %d\r\n", __func__, ret);
-            #endif
+            // pops asks again on every boot, only a new key is written
+            if (!g_keysKnown || memcmp(key, g_keys, sizeof(g_keys)) != 0)
+            {
+                scheduleKeysWrite(key, rif);
+            }
         }
         else
         {
@@ -718,7 +1844,8 @@ static int _sceNpDrmGetVersionKey(unsigned char * key, unsigned char * act, unsi
             }
         }
     }
-    
+
+    HOOK_STATS(STATS_NPDRM_GET_VERSION_KEY, 0, result);
     return result;
 }
 
@@ -733,7 +1860,7 @@ static int _scePspNpDrm_driver_9A34AC9F(unsigned char *rif)
     #endif
     if (result != 0)
     {
-        if (g_keysBinFound || g_isCustomPBP)
+        if (g_isCustomPBP || keysFound())
         {
             result = 0;
             #if DEBUG >= 3
@@ -750,7 +1877,7 @@ static int getRifPatch(char *name, char *path)
 {
     int ret;
 
-    if(g_keysBinFound || g_isCustomPBP) {
+    if(g_isCustomPBP || keysFound()) {
         strcpy(name, PGD_ID);
     }
 
@@ -761,6 +1888,36 @@ static int getRifPatch(char *name, char *path)
     return ret;
 }
 
+static int findRifPath(Signature *sig, u32 addr)
+{
+    _getRifPath = (void*)(addr-32); // found getRifPath
+    return 1;
+}
+
+static int redirectRifPath(Signature *sig, u32 addr)
+{
+    if(_getRifPath == NULL || _lw(addr) != JAL(_getRifPath))
+    {
+        return 0;
+    }
+
+    patchWord(addr, JAL(&getRifPatch)); // redirect calls to getRifPath
+    return 1;
+}
+
+static int removeFwCheck(Signature *sig, u32 addr)
+{
+    patchWord(addr, NOP); // remove the check in scePopsManLoadModule that only allows loading module below the FW 3.XX
+    return 1;
+}
+
+static Signature popsMgrSigs[] = {
+    { 0x34C20016, 0xFFFFFFFF, {{ 0 }}, findRifPath, 1 },
+    // any jal, the action keeps the ones calling getRifPath
+    { JAL_OPCODE, 0xFC000000, {{ 0 }}, redirectRifPath, 2 },
+    { 0x0000000D, 0xFFFFFFFF, {{ 0 }}, removeFwCheck, 1 },
+};
+
 void patchPopsMgr(void)
 {
     SceModule *mod = (SceModule*) sceKernelFindModuleByName("scePops_Manager");
@@ -769,135 +1926,44 @@ void patchPopsMgr(void)
     
     sceNpDrmGetVersionKey = (void*)sctrlHENFindFunction("scePspNpDrm_Driver", "scePspNpDrm_driver", 0x0F9547E6);
     scePspNpDrm_driver_9A34AC9F = (void*)sctrlHENFindFunction("scePspNpDrm_Driver", "scePspNpDrm_driver", 0x9A34AC9F);
-    sctrlHookImportByNID(mod, "scePspNpDrm_driver", 0x0F9547E6, _sceNpDrmGetVersionKey);
-    sctrlHookImportByNID(mod, "scePspNpDrm_driver", 0x9A34AC9F, _scePspNpDrm_driver_9A34AC9F);
+    patchHookImport(mod, "scePspNpDrm_driver", 0x0F9547E6, _sceNpDrmGetVersionKey);
+    patchHookImport(mod, "scePspNpDrm_driver", 0x9A34AC9F, _scePspNpDrm_driver_9A34AC9F);
 
     for(i=0; i<NELEMS(g_ioHooks); ++i)
     {
-        sctrlHookImportByNID(mod, "IoFileMgrForKernel", g_ioHooks[i].nid, g_ioHooks[i].fp);
+        patchHookImport(mod, "IoFileMgrForKernel", g_ioHooks[i].nid, g_ioHooks[i].fp);
     }
 
     if (g_isCustomPBP)
     {
         for(i=0; i<NELEMS(g_amctrlHooks); ++i)
         {
-            sctrlHookImportByNID(mod, "sceAmctrl_driver", g_amctrlHooks[i].nid, g_amctrlHooks[i].fp);
+            patchHookImport(mod, "sceAmctrl_driver", g_amctrlHooks[i].nid, g_amctrlHooks[i].fp);
         }
     }
 
     // patch popsman
-    int patches = 3;
-    for (u32 addr = text_addr; addr<text_addr+mod->text_size && patches; addr+=4){
-        u32 data = _lw(addr);
-        if (data == 0x34C20016){
-            _getRifPath = (void*)(addr-32); // found getRifPath
-        }
-        else if (data == JAL(_getRifPath)){
-            _sw(JAL(&getRifPatch), addr); // redirect calls to getRifPath
-            patches--;
-        }
-        else if (data == 0x0000000D){
-            _sw(NOP, addr); // remove the check in scePopsManLoadModule that only allows loading module below the FW 3.XX
-            patches--;
-        }
-    }
-
+    sigScanCached(text_addr, mod->text_size, popsMgrSigs, NELEMS(popsMgrSigs));
+    patchFlush();
 }
 
 unsigned int isCustomPBP(void)
 {
-    SceUID fd = -1;
-    const char *filename;
-    int result, ret;
-    unsigned int psar_offset, pgd_offset, *magic;
-    unsigned char p[40 + 64], *header;
-
-    header = (unsigned char*)((((unsigned int)p) & ~(64-1)) + 64);
-    filename = sceKernelInitFileName();
-    result = 0;
-
-    if(filename == NULL)
-    {
-        result = 0;
-        goto exit;
-    }
-
-    fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
-
-    if(fd < 0)
-    {
-        #if DEBUG >= 3
-        printk("%s: sceIoOpen %s -> 0x%08X\r\n", __func__, filename, fd);
-        #endif
-        result = 0;
-        goto exit;
-    }
-
-    ret = sceIoRead(fd, header, 40);
-
-    if(ret != 40)
-    {
-        #if DEBUG >= 3
-        printk("%s: sceIoRead -> 0x%08X\r\n", __func__, ret);
-        #endif
-        result = 0;
-        goto exit;
-    }
-
-    psar_offset = *(unsigned int*)(header+0x24);
-    sceIoLseek32(fd, psar_offset, PSP_SEEK_SET);
-    ret = sceIoRead(fd, header, 40);
-
-    if(ret != 40)
-    {
-        #if DEBUG >= 3
-        printk("%s: sceIoRead -> 0x%08X\r\n", __func__, ret);
-        #endif
-        result = 0;
-        goto exit;
-    }
-
-    pgd_offset = psar_offset;
-
-    if(0 == memcmp(header, "PSTITLE", sizeof("PSTITLE")-1))
-    {
-        pgd_offset += 0x200;
-    }
-    else
-    {
-        pgd_offset += 0x400;
-    }
-
-    sceIoLseek32(fd, pgd_offset, PSP_SEEK_SET);
-    ret = sceIoRead(fd, header, 4);
-
-    if(ret != 4)
+    if(!g_probe.valid || !g_probe.has_pgd_word)
     {
-        #if DEBUG >= 3
-        printk("%s: sceIoRead -> 0x%08X\r\n", __func__, ret);
-        #endif
-        result = 0;
-        goto exit;
+        return 0;
     }
 
-    magic = (unsigned int*)header;
-
     // PGD offset
-    if(*magic != 0x44475000)
+    if(g_probe.pgd_word != 0x44475000)
     {
         #if DEBUG >= 3
         printk("%s: custom pops found\r\n", __func__);
         #endif
-        result = 1;
-    }
-
-exit:
-    if(fd >= 0)
-    {
-        sceIoClose(fd);
+        return 1;
     }
 
-    return result;
+    return 0;
 }
 
 static int (*sceMeAudio_67CD7972)(void *buf, int size);
@@ -905,10 +1971,12 @@ int _sceMeAudio_67CD7972(void *buf, int size)
 {
     int ret;
     unsigned int k1;
+    HOOK_BEGIN();
 
     k1 = pspSdkSetK1(0);
     ret = (*sceMeAudio_67CD7972)(buf, size);
     pspSdkSetK1(k1);
+    HOOK_STATS(STATS_MEAUDIO, ret >= 0 ? size : 0, ret);
     #if DEBUG >= 3
     printk("%s: 0x%08X -> 0x%08X\r\n", __func__, size, ret);
     #endif
@@ -929,34 +1997,13 @@ void setupPsxFwVersion(unsigned int fw_version)
 
 int getIcon0Status(void)
 {
-    unsigned int icon0_offset = 0;
     int result = ICON0_MISSING;
-    SceUID fd = -1;;
-    const char *filename;
-    unsigned char p[40 + 64], *header;
-    
-    header = (unsigned char*)((((unsigned int)p) & ~(64-1)) + 64);
-    filename = sceKernelInitFileName();
-
-    if(filename == NULL)
-    {
-        return ICON0_MISSING;
-    }
-    
-    fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
+    unsigned char *header = g_probe.icon0;
 
-    if(fd < 0)
+    if(!g_probe.valid || !g_probe.has_icon0)
     {
         return ICON0_MISSING;
     }
-    
-    sceIoRead(fd, header, 40);
-    icon0_offset = *(unsigned int*)(header+12);
-
-    sceIoLseek32(fd, icon0_offset, PSP_SEEK_SET);
-    sceIoRead(fd, header, 40);
-
-    sceIoClose(fd);
 
     if(*(unsigned int*)(header+4) == 0xA1A0A0D)
     {
@@ -1068,21 +2115,36 @@ static int saveKeysBin(const char *keypath, unsigned char *key, int size)
     return ret;
 }
 
-void getKeys(void)
+static void getKeys(void)
 {
-    char keypath[512];
+    // runs on the stack of whichever hook needs the key first
+    char keypath[256];
     int ret;
     SceIoStat stat;
 
+    g_keysBinFound = 0;
+
+    // custom EBOOTs often carry the DATA.PSP of another title, only signed
+    // ones are looked up in the key store
+    if(!g_isCustomPBP && g_contentId[0] != '\0' && keyStoreEnabled() && keyStoreLookup(g_contentId, g_keys) == 0)
+    {
+        g_keysBinFound = 1;
+        g_keysKnown = 1;
+        #if DEBUG >= 3
+        printk("popcorn: key store hit\r\n");
+        #endif
+        return;
+    }
+
     getKeysBinPath(keypath, sizeof(keypath));
     ret = sceIoGetstat(keypath, &stat);
-    g_keysBinFound = 0;
 
     if(ret == 0)
     {
         if(loadKeysBin(keypath, g_keys, sizeof(g_keys)) == 0)
         {
             g_keysBinFound = 1;
+            g_keysKnown = 1;
             #if DEBUG >= 3
             printk("popcorn: keys.bin found\r\n");
             #endif
@@ -1093,20 +2155,44 @@ void getKeys(void)
 int decompressData(unsigned int destSize, const unsigned char *src, unsigned char *dest)
 {
     unsigned int k1;
+    BlockCacheKey key;
     int ret;
+    HOOK_BEGIN();
 
     k1 = pspSdkSetK1(0);
 
-    ret = sceKernelDeflateDecompress(dest, destSize, src, 0);
-    #if DEBUG >= 3
-    printk("%s: 0x%08X 0x%08X 0x%08X -> 0x%08X\r\n", __func__, (uint)destSize, (uint)src, (uint)dest, ret);
-    #endif
+    ret = blockCacheLookup(src, destSize, dest, &key);
+
+    if(ret <= 0)
+    {
+        int cacheable = (ret == 0);
+        int lz4_size = lz4GetBlockSize(src);
+        u32 inflate_start = sceKernelGetSystemTimeLow();
+
+        // repacked blocks carry an LZ4 header, everything else is deflate
+        if(lz4_size >= 0)
+        {
+            ret = lz4DecompressBlock(dest, destSize, src + LZ4_BLOCK_HEADER_SIZE, lz4_size);
+        }
+        else if(g_builtinInflate)
+        {
+            ret = inflateDecompress(dest, destSize, src);
+        }
+        else
+        {
+            ret = sceKernelDeflateDecompress(dest, destSize, src, 0);
+        }
+
+        blockCacheInsert(cacheable ? &key : NULL, dest, ret, sceKernelGetSystemTimeLow() - inflate_start);
+    }
+
+    // traced with what inflate returned, pops always gets 0x92FF on success
+    HOOK_STATS(STATS_DECOMPRESS, ret >= 0 ? destSize : 0, ret);
+    TRACE(TRACE_DECOMPRESS, -1, (u32)src, destSize, ret, (u32)dest);
+
     if (ret >= 0)
     {
         ret = 0x92FF;
-        #if DEBUG >= 3
-        printk("%s: [FAKE] -> 0x%08X\r\n", __func__, ret);
-        #endif
     }
 
     pspSdkSetK1(k1);
@@ -1114,38 +2200,79 @@ int decompressData(unsigned int destSize, const unsigned char *src, unsigned cha
     return ret;
 }
 
+static void *g_popsManDecompressStub;
+
+// The pops actions match on the text alone so the locations can be cached,
+// the per game conditions are only checked when patching.
+static int callDecompressStub(Signature *sig, u32 addr)
+{
+    if(g_isCustomPBP)
+    {
+        patchWord(addr+8, JAL(g_popsManDecompressStub));
+    }
+
+    return 1;
+}
+
+static int patchIcon0Size(Signature *sig, u32 addr)
+{
+    if(g_icon0Status != ICON0_OK)
+    {
+        patchWord(addr, 0x24050000 | (sizeof(g_icon_png) & 0xFFFF)); // patch icon0 size
+    }
+
+    return 1;
+}
+
+static int patchManualNameCheck(Signature *sig, u32 addr)
+{
+    patchWord(addr+8, 0x24020001); // Patch Manual Name Check
+    return 1;
+}
+
+static int patchIndexLength(Signature *sig, u32 addr)
+{
+    // Fix index length (enable CDDA)
+    patchHalf(addr + 2, 0x1000);
+    patchHalf(addr + 4, 0);
+    return 1;
+}
+
+// no fixed match counts, every match is patched
+static Signature popsSigs[] = {
+    { 0x8E66000C, 0xFFFFFFFF, {{ 0 }}, callDecompressStub, 0 },
+    { 0x00432823, 0xFFFFFFFF, {{ 0 }}, patchIcon0Size, 0 },
+    { 0x24050080, 0xFFFFFFFF, {{ 24, 0x24030001, 0xFFFFFFFF }}, patchManualNameCheck, 0 },
+    { 0x14C00014, 0xFFFFFFFF, {{ 4, 0x24E2FFFF, 0xFFFFFFFF }}, patchIndexLength, 0 },
+    { 0x14A00014, 0xFFFFFFFF, {{ 4, 0x24C2FFFF, 0xFFFFFFFF }}, patchIndexLength, 0 },
+};
+
 static void patchPops(SceModule *mod)
 {
     unsigned int text_addr = mod->text_addr;
-    void* scePopsMan_0090B2C8_stub = (void*)sctrlFindImportByNID(mod, "scePopsMan", 0x0090B2C8);
+
+    g_popsManDecompressStub = (void*)sctrlFindImportByNID(mod, "scePopsMan", 0x0090B2C8);
 
     #if DEBUG >= 3
     printk("%s: patching pops\r\n", __func__);
     #endif
 
-    for (u32 addr = text_addr; addr<text_addr+mod->text_size; addr+=4){
-        u32 data = _lw(addr);
-        if (data == 0x8E66000C && g_isCustomPBP)
-            _sw(JAL(scePopsMan_0090B2C8_stub), addr+8);
-        else if (data == 0x00432823 && g_icon0Status != ICON0_OK)
-            _sw(0x24050000 | (sizeof(g_icon_png) & 0xFFFF), addr); // patch icon0 size
-        else if (data == 0x24050080 && _lw(addr+24) == 0x24030001)
-            _sw(0x24020001, addr+8); // Patch Manual Name Check
-        else if ((data == 0x14C00014 && _lw(addr + 4) == 0x24E2FFFF) ||
-            (data == 0x14A00014 && _lw(addr + 4) == 0x24C2FFFF))
-        {   // Fix index length (enable CDDA)
-            _sh(0x1000, addr + 2);
-            _sh(0, addr + 4);
-        }
-    }
+    sigScanCached(text_addr, mod->text_size, popsSigs, NELEMS(popsSigs));
 
     if(g_isCustomPBP){
-        sctrlHookImportByNID(mod, "scePopsMan", 0x0090B2C8, decompressData);
+        g_builtinInflate = getConfigInt("builtin_inflate", 0);
+
+        if(g_builtinInflate)
+        {
+            inflateModuleInit();
+        }
+
+        patchHookImport(mod, "scePopsMan", 0x0090B2C8, decompressData);
     }
     
     // Prevent Permission Problems
     sceMeAudio_67CD7972 = (void*)sctrlHENFindFunction("scePops_Manager", "sceMeAudio", 0x2AB4FE43);
-    sctrlHookImportByNID(mod, "sceMeAudio", 0x2AB4FE43, _sceMeAudio_67CD7972);
+    patchHookImport(mod, "sceMeAudio", 0x2AB4FE43, _sceMeAudio_67CD7972);
 
-    sctrlFlushCache();
+    patchFlush();
 }
@@ -0,0 +1,311 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#include <string.h>
+#include <pspkernel.h>
+
+#include <cfwmacros.h>
+#include <systemctrl.h>
+
+#include "config.h"
+#include "trace.h"
+
+#if DEBUG >= 3
+
+// Hooks append fixed size records to a ring and never wait: the only shared
+// state is the head sequence number, reserved with interrupts off. A record
+// is committed by storing its sequence number last, so the flusher can tell
+// finished records from ones that are still being written or got overwritten.
+#define TRACE_FILE_NAME "popcorn.trace"
+#define TRACE_MAGIC 0x52544350 // PCTR
+#define TRACE_VERSION 1
+#define TRACE_RECORDS 1024 // power of two
+#define TRACE_CHUNK 32
+#define TRACE_FLUSH_INTERVAL 200000
+#define TRACE_THREAD_PRIORITY 0x70
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 record_size;
+    u32 ring_records;
+} TraceFileHeader;
+
+typedef struct
+{
+    u32 seq;
+    u32 time; // sceKernelGetSystemTimeLow on entry
+    u16 duration; // us, saturated
+    u8 hook;
+    u8 reserved;
+    union
+    {
+        struct
+        {
+            s32 fd;
+            u32 pos;
+            u32 size;
+            s32 ret;
+            u32 arg;
+        };
+        char path[20]; // TRACE_PATH_TAIL, not terminated when full
+    };
+} TraceRecord;
+
+static TraceRecord g_traceRing[TRACE_RECORDS];
+static volatile u32 g_traceHead;
+static u32 g_traceTail;
+static TraceRecord g_traceChunk[TRACE_CHUNK];
+static SceUID g_traceLock = -1;
+static char g_tracePath[64];
+
+static u32 traceReserve(int count)
+{
+    unsigned int intr = sceKernelCpuSuspendIntr();
+    u32 seq = g_traceHead;
+
+    g_traceHead = seq + count;
+    sceKernelCpuResumeIntr(intr);
+
+    return seq;
+}
+
+static void traceCommit(TraceRecord *record, u32 seq)
+{
+    // the payload has to land before the sequence number
+    __asm__ __volatile__("" ::: "memory");
+    record->seq = seq;
+}
+
+static void traceFill(TraceRecord *record, int hook, int fd, u32 pos, u32 size, int ret, u32 arg, u32 start)
+{
+    u32 duration = sceKernelGetSystemTimeLow() - start;
+
+    record->time = start;
+    record->duration = duration > 0xFFFF ? 0xFFFF : duration;
+    record->hook = hook;
+    record->reserved = 0;
+    record->fd = fd;
+    record->pos = pos;
+    record->size = size;
+    record->ret = ret;
+    record->arg = arg;
+}
+
+void traceRecord(int hook, int fd, u32 pos, u32 size, int ret, u32 arg, u32 start)
+{
+    u32 seq = traceReserve(1);
+    TraceRecord *record = &g_traceRing[seq & (TRACE_RECORDS-1)];
+
+    traceFill(record, hook, fd, pos, size, ret, arg, start);
+    traceCommit(record, seq);
+}
+
+// the record is followed by one holding the last characters of path
+void tracePath(int hook, int fd, const char *path, int ret, u32 arg, u32 start)
+{
+    u32 seq = traceReserve(2);
+    TraceRecord *record = &g_traceRing[seq & (TRACE_RECORDS-1)];
+    TraceRecord *tail = &g_traceRing[(seq + 1) & (TRACE_RECORDS-1)];
+    int len = strlen(path);
+
+    traceFill(record, hook, fd, 0, len, ret, arg, start);
+
+    tail->time = start;
+    tail->duration = 0;
+    tail->hook = TRACE_PATH_TAIL;
+    tail->reserved = 0;
+
+    if(len > sizeof(tail->path))
+    {
+        path += len - sizeof(tail->path);
+        len = sizeof(tail->path);
+    }
+
+    memset(tail->path, 0, sizeof(tail->path));
+    memcpy(tail->path, path, len);
+
+    traceCommit(record, seq);
+    traceCommit(tail, seq + 1);
+}
+
+static int traceChunkAdd(SceUID fd, int n, int *written)
+{
+    if(++n == TRACE_CHUNK)
+    {
+        *written += sceIoWrite(fd, g_traceChunk, sizeof(g_traceChunk));
+        n = 0;
+    }
+
+    return n;
+}
+
+// Copies committed records out of the ring in chunks and appends them to the
+// trace file. Records overwritten before they could be copied are replaced by
+// a single TRACE_LOST record.
+static int traceWrite(void)
+{
+    u32 head = g_traceHead;
+    u32 lost = 0;
+    int n = 0, written = 0;
+    SceUID fd;
+
+    fd = sceIoOpen(g_tracePath, PSP_O_WRONLY | PSP_O_APPEND, 0777);
+
+    if(fd < 0)
+    {
+        return fd;
+    }
+
+    while(g_traceTail != head)
+    {
+        TraceRecord *record;
+        u32 seq;
+
+        if(head - g_traceTail > TRACE_RECORDS)
+        {
+            lost += head - g_traceTail - TRACE_RECORDS;
+            g_traceTail = head - TRACE_RECORDS;
+        }
+
+        record = &g_traceRing[g_traceTail & (TRACE_RECORDS-1)];
+        seq = record->seq;
+
+        if((s32)(seq - g_traceTail) > 0)
+        {
+            // overwritten by a writer that wrapped around
+            lost++;
+            g_traceTail++;
+            continue;
+        }
+
+        if(seq != g_traceTail)
+        {
+            // still being written, picked up by the next flush
+            break;
+        }
+
+        if(lost)
+        {
+            memset(&g_traceChunk[n], 0, sizeof(g_traceChunk[n]));
+            g_traceChunk[n].seq = g_traceTail - lost;
+            g_traceChunk[n].hook = TRACE_LOST;
+            g_traceChunk[n].size = lost;
+            n = traceChunkAdd(fd, n, &written);
+            lost = 0;
+        }
+
+        memcpy(&g_traceChunk[n], record, sizeof(*record));
+
+        // overwritten while copying, counted as lost on the next pass
+        if(record->seq != seq)
+        {
+            continue;
+        }
+
+        g_traceTail++;
+        n = traceChunkAdd(fd, n, &written);
+    }
+
+    if(n > 0)
+    {
+        written += sceIoWrite(fd, g_traceChunk, n * sizeof(*g_traceChunk));
+    }
+
+    sceIoClose(fd);
+
+    return written;
+}
+
+static int traceThread(SceSize args, void *argp)
+{
+    while(1)
+    {
+        sceKernelDelayThread(TRACE_FLUSH_INTERVAL);
+        popcornTraceFlush();
+    }
+
+    return 0;
+}
+
+void traceInit(void)
+{
+    TraceFileHeader header;
+    SceUID fd, thid;
+
+    if(g_traceLock >= 0)
+    {
+        return;
+    }
+
+    if(getPluginDataPath(TRACE_FILE_NAME, g_tracePath, sizeof(g_tracePath)) < 0)
+    {
+        return;
+    }
+
+    fd = sceIoOpen(g_tracePath, PSP_O_WRONLY | PSP_O_CREAT | PSP_O_TRUNC, 0777);
+
+    if(fd < 0)
+    {
+        printk("%s: cannot create %s -> 0x%08X\r\n", __func__, g_tracePath, fd);
+        return;
+    }
+
+    // no sequence number matches before the first record is committed
+    memset(g_traceRing, 0xFF, sizeof(g_traceRing));
+
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.ring_records = TRACE_RECORDS;
+    sceIoWrite(fd, &header, sizeof(header));
+    sceIoClose(fd);
+
+    g_traceLock = sceKernelCreateSema("PopcornTrace", 0, 1, 1, NULL);
+    thid = sceKernelCreateThread("PopcornTrace", traceThread, TRACE_THREAD_PRIORITY, 0x1000, 0, NULL);
+
+    if(thid >= 0)
+    {
+        sceKernelStartThread(thid, 0, NULL);
+    }
+}
+
+int popcornTraceFlush(void)
+{
+    int ret;
+
+    if(g_traceLock < 0)
+    {
+        return -1;
+    }
+
+    sceKernelWaitSema(g_traceLock, 1, NULL);
+    ret = traceWrite();
+    sceKernelSignalSema(g_traceLock, 1);
+
+    return ret;
+}
+
+#else
+
+int popcornTraceFlush(void)
+{
+    return -1;
+}
+
+#endif
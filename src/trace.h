@@ -0,0 +1,61 @@
+/*
+* This file is part of PRO CFW.
+
+* PRO CFW is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* PRO CFW is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with PRO CFW. If not, see <http://www.gnu.org/licenses/ .
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <psptypes.h>
+
+// hook ids in trace records, tools/popcorn_trace.py has the same list
+enum
+{
+    TRACE_PATH_TAIL = 0, // continues the previous record with the end of a path
+    TRACE_IO_OPEN,
+    TRACE_IO_LSEEK,
+    TRACE_IO_LSEEK32,
+    TRACE_IO_IOCTL,
+    TRACE_IO_READ,
+    TRACE_IO_READ_ASYNC,
+    TRACE_IO_ASYNC_DONE,
+    TRACE_IO_WRITE,
+    TRACE_IO_GETSTAT,
+    TRACE_IO_CLOSE,
+    TRACE_DECOMPRESS,
+    TRACE_LOST, // written by the flusher, size is the number of dropped records
+};
+
+#if DEBUG >= 3
+
+void traceInit(void);
+void traceRecord(int hook, int fd, u32 pos, u32 size, int ret, u32 arg, u32 start);
+void tracePath(int hook, int fd, const char *path, int ret, u32 arg, u32 start);
+
+// hooks log once on exit, with the start time taken by HOOK_BEGIN
+#define TRACE(hook, fd, pos, size, ret, arg) traceRecord(hook, fd, pos, size, ret, arg, hook_start)
+#define TRACE_PATH(hook, fd, path, ret, arg) tracePath(hook, fd, path, ret, arg, hook_start)
+
+#else
+
+#define TRACE(hook, fd, pos, size, ret, arg)
+#define TRACE_PATH(hook, fd, path, ret, arg)
+
+#endif
+
+// writes everything traced so far to seplugins/popcorn.trace
+int popcornTraceFlush(void);
+
+#endif
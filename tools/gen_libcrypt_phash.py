@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+#
+# Generate libcrypt_phash.h, a perfect hash over the libcrypt magic word table.
+#
+# usage: gen_libcrypt_phash.py src/libcrypt_table.h libcrypt_phash.h
+#
+# Disc IDs like "_SLES_02080" are packed into a 32-bit key,
+# ((prefix index + 1) << 17) | number, so a lookup is one key compare instead
+# of string compares. Keys are placed with hash-and-displace: every key falls
+# into a bucket by libcryptHash(key, 0), and each bucket stores the seed that
+# sends all of its keys to free slots with libcryptHash(key, seed).
+
+import re
+import sys
+
+SLOTS = 256
+BUCKETS = 64
+MAX_SEED = 0xFF
+
+ENTRY = re.compile(r'\{"_([A-Z]{4})_(\d{5})",\s*(\d+)\}')
+
+
+def libcrypt_hash(key, seed):
+    # must match libcryptHash in src/libcrypt.c
+    h = (key ^ (seed * 0x9E3779B1)) & 0xFFFFFFFF
+    h = (h * 0x85EBCA6B) & 0xFFFFFFFF
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & 0xFFFFFFFF
+    h ^= h >> 16
+    return h
+
+
+def parse(path):
+    entries = []
+    with open(path) as f:
+        for line in f:
+            m = ENTRY.search(line)
+            if m:
+                entries.append((m.group(1), int(m.group(2)), int(m.group(3))))
+    return entries
+
+
+def build(entries):
+    prefixes = sorted(set(p for p, _, _ in entries))
+    keys = {}
+
+    for prefix, number, word in entries:
+        key = ((prefixes.index(prefix) + 1) << 17) | number
+        if key in keys:
+            sys.exit("duplicate disc id %s_%05d" % (prefix, number))
+        if word > 0xFFFF:
+            sys.exit("magic word of %s_%05d does not fit 16 bits" % (prefix, number))
+        keys[key] = word
+
+    if len(keys) > SLOTS:
+        sys.exit("%d entries do not fit %d slots" % (len(keys), SLOTS))
+
+    buckets = [[] for _ in range(BUCKETS)]
+    for key in keys:
+        buckets[libcrypt_hash(key, 0) % BUCKETS].append(key)
+
+    slots = [0] * SLOTS
+    seeds = [0] * BUCKETS
+
+    for b in sorted(range(BUCKETS), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            break
+        for seed in range(1, MAX_SEED + 1):
+            taken = set()
+            for key in buckets[b]:
+                slot = libcrypt_hash(key, seed) % SLOTS
+                if slots[slot] or slot in taken:
+                    break
+                taken.add(slot)
+            else:
+                for key in buckets[b]:
+                    slots[libcrypt_hash(key, seed) % SLOTS] = key
+                seeds[b] = seed
+                break
+        else:
+            sys.exit("no seed found for bucket %d, raise SLOTS" % b)
+
+    words = [keys[k] if k else 0 for k in slots]
+    return prefixes, seeds, slots, words
+
+
+def table(values, fmt, per_line):
+    out = []
+    for i in range(0, len(values), per_line):
+        out.append("    " + ", ".join(fmt % v for v in values[i:i + per_line]) + ",")
+    return "\n".join(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: %s libcrypt_table.h libcrypt_phash.h" % sys.argv[0])
+
+    entries = parse(sys.argv[1])
+    prefixes, seeds, slots, words = build(entries)
+
+    prefix_words = [int.from_bytes(p.encode(), "little") for p in prefixes]
+
+    with open(sys.argv[2], "w") as f:
+        f.write("// Generated by tools/gen_libcrypt_phash.py from libcrypt_table.h, do not edit.\n")
+        f.write("// %d disc ids in %d slots\n\n" % (len(entries), SLOTS))
+        f.write("#define LIBCRYPT_PREFIXES %d\n" % len(prefixes))
+        f.write("#define LIBCRYPT_BUCKETS %d\n" % BUCKETS)
+        f.write("#define LIBCRYPT_SLOTS %d\n\n" % SLOTS)
+        f.write("// disc id prefixes as little endian words (%s)\n" % ", ".join(prefixes))
+        f.write("static const u32 libcrypt_prefixes[LIBCRYPT_PREFIXES] = {\n%s\n};\n\n"
+                % table(prefix_words, "0x%08X", 4))
+        f.write("static const u8 libcrypt_seeds[LIBCRYPT_BUCKETS] = {\n%s\n};\n\n"
+                % table(seeds, "%5d", 8))
+        f.write("static const u32 libcrypt_keys[LIBCRYPT_SLOTS] = {\n%s\n};\n\n"
+                % table(slots, "0x%05X", 8))
+        f.write("static const u16 libcrypt_words[LIBCRYPT_SLOTS] = {\n%s\n};\n"
+                % table(words, "%5d", 8))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+#
+# Import per-game KEYS.BIN files into the key store (seplugins/popcorn.keys)
+# read by src/keystore.c.
+#
+# usage: mkkeystore.py popcorn.keys DIR [more dirs...]
+#
+# Every KEYS.BIN found below the directories is filed under the content ID of
+# the EBOOT.PBP next to it, read from its DATA.PSP. Records of an existing
+# store are kept; keys found in the directories replace them.
+#
+# Layout, all little endian:
+#   header  32 bytes: magic "PCKS", version, record size, record count,
+#           records per page, page count, data offset, appended count
+#   index   page count x content ID of the first record of each page
+#   data    records of (content ID, key) sorted by content ID, followed by
+#           the appended count of unsorted records the module added since
+# where a content ID is 36 characters padded with zeros to 48 bytes.
+
+import os
+import re
+import struct
+import sys
+
+# must match src/keystore.c
+MAGIC = 0x534B4350
+VERSION = 1
+MAX_PAGES = 16
+PAGE_RECORDS = 32
+ID_SIZE = 0x30
+KEY_SIZE = 16
+
+# must match src/syspatch.c
+DATA_PSP_CONTENT_ID = 0x560
+
+HEADER = struct.Struct("<IHHIHHII8x")
+RECORD = struct.Struct("<%ds%ds" % (ID_SIZE, KEY_SIZE))
+PBP_HEADER = struct.Struct("<10I")
+
+CONTENT_ID = re.compile(rb"[0-9A-Z]{6}-[0-9A-Z]{9}_[0-9A-Z]{2}-[0-9A-Z]{16}")
+
+
+def content_id(eboot):
+    with open(eboot, "rb") as f:
+        header = f.read(PBP_HEADER.size)
+        if len(header) != PBP_HEADER.size or header[:4] != b"\0PBP":
+            return None
+        elf_offset = PBP_HEADER.unpack(header)[8]
+        f.seek(elf_offset + DATA_PSP_CONTENT_ID)
+        cid = f.read(ID_SIZE)[:36]
+
+    return cid.ljust(ID_SIZE, b"\0") if CONTENT_ID.fullmatch(cid) else None
+
+
+def load_store(path):
+    keys = {}
+
+    if not os.path.exists(path):
+        return keys
+
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if len(data) < HEADER.size:
+        sys.exit("%s: no key store header" % path)
+
+    magic, version, record_size, count, _, _, data_offset, appended = HEADER.unpack_from(data)
+
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit("%s: not a key store (magic 0x%08X version %d)" % (path, magic, version))
+
+    # appended records come last and replace sorted ones
+    for i in range(count + appended):
+        cid, key = RECORD.unpack_from(data, data_offset + i * RECORD.size)
+        keys[cid] = key
+
+    return keys
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: %s popcorn.keys DIR [more dirs...]" % sys.argv[0])
+
+    keys = load_store(sys.argv[1])
+    known = len(keys)
+    imported = skipped = 0
+
+    for top in sys.argv[2:]:
+        for root, _, files in os.walk(top):
+            if "KEYS.BIN" not in files:
+                continue
+
+            eboot = os.path.join(root, "EBOOT.PBP")
+            cid = content_id(eboot) if os.path.exists(eboot) else None
+
+            with open(os.path.join(root, "KEYS.BIN"), "rb") as f:
+                key = f.read(KEY_SIZE + 1)
+
+            if cid is None or len(key) != KEY_SIZE:
+                print("%s: skipped, no content ID or not a 16 byte key" % root)
+                skipped += 1
+                continue
+
+            keys[cid] = key
+            imported += 1
+
+    ids = sorted(keys)
+    pages = (len(ids) + PAGE_RECORDS - 1) // PAGE_RECORDS
+
+    if pages > MAX_PAGES:
+        sys.exit("%d records need %d pages, popcorn reads at most %d" % (len(ids), pages, MAX_PAGES))
+
+    data_offset = HEADER.size + pages * ID_SIZE
+
+    with open(sys.argv[1], "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, RECORD.size, len(ids), PAGE_RECORDS, pages, data_offset, 0))
+        for page in range(pages):
+            f.write(ids[page * PAGE_RECORDS])
+        for cid in ids:
+            f.write(RECORD.pack(cid, keys[cid]))
+
+    print("%s: %d records in %d pages, %d imported, %d skipped, %d were there before" % (
+        sys.argv[1], len(ids), pages, imported, skipped, known))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+#
+# Build the on-disk libcrypt database (seplugins/libcrypt.db) read by
+# searchMagicWord in src/libcrypt.c.
+#
+# usage: mklibcryptdb.py libcrypt.db src/libcrypt_table.h [more tables...]
+#
+# Inputs use the libcrypt_table.h entry format, {"_SLES_02080", 40416}, so
+# newly dumped titles can go in a separate file without rebuilding the PRX.
+# Later inputs override earlier ones for the same disc id.
+#
+# Layout, all little endian:
+#   header  32 bytes: magic "LCDB", version, record size, record count,
+#           records per page, page count, data offset
+#   index   page count x (prefix, number) of the first record of each page
+#   data    records of (prefix, number, magic word) sorted by (prefix, number)
+# where prefix is the 4 letters of the id read as a little endian word.
+
+import struct
+import sys
+
+from gen_libcrypt_phash import parse
+
+# must match src/libcrypt.c
+MAGIC = 0x4244434C
+VERSION = 1
+MAX_PAGES = 24
+PAGE_RECORDS = 32
+
+HEADER = struct.Struct("<IHHIHHI12x")
+KEY = struct.Struct("<II")
+RECORD = struct.Struct("<III")
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: %s libcrypt.db libcrypt_table.h [more tables...]" % sys.argv[0])
+
+    words = {}
+    for path in sys.argv[2:]:
+        for prefix, number, word in parse(path):
+            words[(int.from_bytes(prefix.encode(), "little"), number)] = word
+
+    keys = sorted(words)
+    pages = (len(keys) + PAGE_RECORDS - 1) // PAGE_RECORDS
+
+    if pages > MAX_PAGES:
+        sys.exit("%d records need %d pages, popcorn reads at most %d" % (len(keys), pages, MAX_PAGES))
+
+    data_offset = HEADER.size + pages * KEY.size
+
+    with open(sys.argv[1], "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, RECORD.size, len(keys), PAGE_RECORDS, pages, data_offset))
+        for page in range(pages):
+            f.write(KEY.pack(*keys[page * PAGE_RECORDS]))
+        for key in keys:
+            f.write(RECORD.pack(key[0], key[1], words[key]))
+
+    print("%s: %d records in %d pages" % (sys.argv[1], len(keys), pages))
+
+
+if __name__ == "__main__":
+    main()
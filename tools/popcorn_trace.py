@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+#
+# Decode seplugins/popcorn.trace written by DEBUG=3 builds (src/trace.c).
+#
+# usage: popcorn_trace.py [--csv] popcorn.trace
+#
+# Prints one line per hook call: time relative to the first record in us,
+# time spent in the hook, the hook and its arguments. Paths of sceIoOpen and
+# sceIoGetstat are cut to their last 20 characters.
+
+import csv
+import struct
+import sys
+
+# must match src/trace.c
+MAGIC = 0x52544350
+VERSION = 1
+
+HEADER = struct.Struct("<IIII")
+RECORD = struct.Struct("<IIHBBiIIiI")
+PATH = struct.Struct("<IIHBB20s")
+
+# must match the enum in src/trace.h
+PATH_TAIL = 0
+LOST = 12
+HOOKS = [
+    "path",
+    "sceIoOpen",
+    "sceIoLseek",
+    "sceIoLseek32",
+    "sceIoIoctl",
+    "sceIoRead",
+    "sceIoReadAsync",
+    "asyncDone",
+    "sceIoWrite",
+    "sceIoGetstat",
+    "sceIoClose",
+    "decompressData",
+    "lost",
+]
+
+FIELDS = ["seq", "time", "duration", "hook", "fd", "pos", "size", "ret", "arg", "path"]
+
+
+def records(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if len(data) < HEADER.size:
+        sys.exit("%s: no trace header" % path)
+
+    magic, version, record_size, ring = HEADER.unpack_from(data)
+
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit("%s: not a popcorn trace (magic 0x%08X version %d)" % (path, magic, version))
+
+    rows = []
+    for offset in range(HEADER.size, len(data) - RECORD.size + 1, RECORD.size):
+        seq, time, duration, hook, _, fd, pos, size, ret, arg = RECORD.unpack_from(data, offset)
+
+        if hook == PATH_TAIL:
+            name = PATH.unpack_from(data, offset)[5].rstrip(b"\0").decode("ascii", "replace")
+            if rows and rows[-1]["seq"] == seq - 1:
+                rows[-1]["path"] = name
+            continue
+
+        rows.append({
+            "seq": seq,
+            "time": time,
+            "duration": duration,
+            "hook": HOOKS[hook] if hook < len(HOOKS) else "hook%d" % hook,
+            "fd": fd,
+            "pos": pos,
+            "size": size,
+            "ret": ret,
+            "arg": arg,
+            "path": "",
+        })
+
+    return rows
+
+
+def main():
+    args = sys.argv[1:]
+    as_csv = "--csv" in args
+    args = [a for a in args if a != "--csv"]
+
+    if len(args) != 1:
+        sys.exit("usage: %s [--csv] popcorn.trace" % sys.argv[0])
+
+    rows = records(args[0])
+    start = next((r["time"] for r in rows if r["hook"] != "lost"), 0)
+
+    for r in rows:
+        r["time"] = (r["time"] - start) & 0xFFFFFFFF
+
+    if as_csv:
+        writer = csv.DictWriter(sys.stdout, FIELDS)
+        writer.writeheader()
+        writer.writerows(rows)
+        return
+
+    for r in rows:
+        if r["hook"] == "lost":
+            print("%12s %6s  %d records lost" % ("", "", r["size"]))
+            continue
+
+        print("%12d %6d  %-14s fd=0x%08X pos=0x%08X size=0x%08X ret=0x%08X arg=0x%08X %s" % (
+            r["time"], r["duration"], r["hook"], r["fd"] & 0xFFFFFFFF, r["pos"], r["size"],
+            r["ret"] & 0xFFFFFFFF, r["arg"], r["path"]))
+
+
+if __name__ == "__main__":
+    main()